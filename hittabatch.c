@@ -0,0 +1,303 @@
+/*
+ * hittabatch.c - This file is part of ncidd.
+ *
+ * LA: find names for many numbers at once, with the ncidd lookup code
+ *
+ * The numbers are read from a call log, or one per line from stdin.
+ * Each number is looked up once, by a pool of at most -j lookups that
+ * run at the same time, and no more than -r lookups are started each
+ * second so hitta.se is not flooded.  The numbers are looked up by
+ * hittaAlias() as in ncidd, so the cache and the cache file are used
+ * and filled the same way, see --hitta in ncidd.
+ *
+ * Call log lines are written again with the NAME found, other lines are
+ * written as the number, a tab and the name.  Progress and throughput
+ * are written to stderr.
+ *
+ * usage: hittabatch [-j jobs] [-r rate] [-o output] [-v level]
+ *                   [-H word=value] ... [cidcall.log]
+ *
+ * ncidd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ncidd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ncidd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ncidd.h"
+#include "hittatool.h"
+
+#define BATCHJOBS       4           /* lookups at the same time */
+#define BATCHRATE       2           /* lookups started each second */
+#define BATCHREPORT     5000        /* ms between progress lines */
+
+/* a number to look up, for one or more input lines */
+struct job
+{
+    char nmbr[CIDSIZE];             /* tidy */
+    char name[CIDSIZE];             /* empty if none was found */
+    int done;
+};
+
+static int running, finished, named;
+static struct job *jobs;
+static int jobcount;
+
+static void usage(char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [-j jobs] [-r rate] [-o output] [-v level]\n"
+        "       [-H word=value] ... [cidcall.log]\n"
+        "  -j  lookups at the same time, default %d\n"
+        "  -r  lookups started each second, default %d\n"
+        "  -o  output file, default stdout\n"
+        "  -v  log level on stderr, default 1\n"
+        "  -H  lookup option as --hitta in ncidd, repeatable\n",
+        prog, BATCHJOBS, BATCHRATE);
+    exit(1);
+}
+
+static int compareJob(const void *a, const void *b)
+{
+    return strcmp(((struct job *) a)->nmbr, ((struct job *) b)->nmbr);
+}
+
+static struct job *findJob(char *nmbr)
+{
+    struct job key;
+
+    strncpy(key.nmbr, nmbr, CIDSIZE - 1);
+    key.nmbr[CIDSIZE - 1] = 0;
+    return (struct job *) bsearch(&key, jobs, jobcount, sizeof(struct job),
+        compareJob);
+}
+
+/*
+ * the number of a line, a call log field or the whole line, tidy
+ * returns a pointer to the NMBR field of a call log line, or 0
+ */
+static char *lineNmbr(char *line, char *nmbr)
+{
+    char *ptr, *end;
+
+    *nmbr = 0;
+    if ((ptr = strstr(line, NMBR)))
+    {
+        ptr += strlen(NMBR);
+        if (!(end = strchr(ptr, '*')) || end - ptr >= CIDSIZE) return 0;
+        strncpy(nmbr, ptr, end - ptr);
+        nmbr[end - ptr] = 0;
+    }
+    else
+    {
+        end = line + strcspn(line, "\r\n");
+        if (end - line >= CIDSIZE) return 0;
+        strncpy(nmbr, line, end - line);
+        nmbr[end - line] = 0;
+    }
+    hittaTidy(nmbr);
+
+    return ptr;
+}
+
+static void report(long start, int total)
+{
+    char msgbuf[BUFSIZ];
+    long ms = hittaNow() - start;
+
+    sprintf(msgbuf, "%d/%d numbers, %d named, %d running, %.1f/s, "
+        "cache %lu hits %lu misses [%s]\n",
+        finished, total, named, running,
+        ms > 0 ? finished * 1000.0 / ms : 0.0,
+        cachehits, cachemisses, strdate(ONLYTIME));
+    logMsg(LEVEL1, msgbuf);
+}
+
+/* a lookup from the pool is done */
+static void batchDone(char *name, void *arg)
+{
+    struct job *job = (struct job *) arg;
+
+    strncpy(job->name, name, CIDSIZE - 1);
+    job->done = 1;
+    if (*job->name) ++named;
+    ++finished;
+    --running;
+}
+
+int main(int argc, char *argv[])
+{
+    char **lines = 0, buf[BUFSIZ], nmbr[CIDSIZE], name[CIDSIZE];
+    char *ptr, *end, *output = 0;
+    int c, pos, timeout, next, total;
+    int maxjobs = BATCHJOBS, rate = BATCHRATE, linecount = 0, linemax = 0;
+    long start, nextstart, lastreport;
+    struct job *job;
+    FILE *in = stdin, *out = stdout;
+
+    /* a batch waits for a failing hitta.se instead of skipping numbers */
+    hittatrip = 0;
+    /* -r paces the batch, ncidd's calls are not in this process */
+    hittarate = 0;
+    cachewarm = 0;
+
+    while ((c = getopt(argc, argv, "j:r:o:v:H:")) != -1)
+    {
+        switch (c)
+        {
+            case 'j':
+                maxjobs = atoi(optarg);
+                if (maxjobs < 1 || maxjobs > MAXCONNECT / 2) usage(argv[0]);
+                break;
+            case 'r':
+                rate = atoi(optarg);
+                if (rate < 1 || rate > 1000) usage(argv[0]);
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'v':
+                verbose = atoi(optarg);
+                break;
+            case 'H':
+                if (hittaSet(optarg))
+                {
+                    fprintf(stderr, "Invalid hitta option: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind < argc - 1) usage(argv[0]);
+    if (optind == argc - 1 && !(in = fopen(argv[optind], "r")))
+    {
+        perror(argv[optind]);
+        exit(1);
+    }
+
+    /* all lines, and one job for each number */
+    while (fgets(buf, sizeof(buf), in))
+    {
+        if (linecount == linemax)
+        {
+            linemax = linemax ? linemax * 2 : 1024;
+            if (!(lines = (char **) realloc(lines, linemax * sizeof(char *))) ||
+                !(jobs = (struct job *) realloc(jobs,
+                    linemax * sizeof(struct job))))
+            {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        if (!(lines[linecount++] = strdup(buf)))
+        {
+            perror("strdup");
+            exit(1);
+        }
+        lineNmbr(buf, nmbr);
+        if (strlen(nmbr) < 3) continue;
+        memset(&jobs[jobcount], 0, sizeof(struct job));
+        strcpy(jobs[jobcount++].nmbr, nmbr);
+    }
+    if (in != stdin) fclose(in);
+
+    /* each number once */
+    qsort(jobs, jobcount, sizeof(struct job), compareJob);
+    for (total = next = 0; next < jobcount; ++next)
+    {
+        if (total && !strcmp(jobs[total - 1].nmbr, jobs[next].nmbr)) continue;
+        jobs[total++] = jobs[next];
+    }
+    jobcount = total;
+
+    if (hittaInit())
+    {
+        fprintf(stderr, "Cannot initialize hitta.se lookups\n");
+        exit(1);
+    }
+
+    start = nextstart = lastreport = hittaNow();
+    sprintf(buf, "%d lines, %d numbers, %d jobs, %d/s\n",
+        linecount, jobcount, maxjobs, rate);
+    logMsg(LEVEL1, buf);
+
+    for (next = 0; next < jobcount || running; )
+    {
+        /* start lookups while the pool and the rate allow */
+        while (next < jobcount && running < maxjobs && hittaNow() >= nextstart)
+        {
+            job = &jobs[next++];
+            strcpy(nmbr, job->nmbr);
+            *name = 0;
+            ++running;
+            if (!hittaAlias(name, nmbr, HITTA_BACKGROUND, batchDone, job))
+            {
+                /* from the cache, no request was sent */
+                batchDone(name, job);
+                continue;
+            }
+            nextstart += 1000 / rate;
+            if (nextstart < hittaNow()) nextstart = hittaNow();
+        }
+
+        timeout = BATCHREPORT;
+        if (next < jobcount && running < maxjobs &&
+            nextstart - hittaNow() < timeout)
+            timeout = nextstart > hittaNow() ? (int) (nextstart - hittaNow()) : 0;
+
+        if (toolPoll(timeout) < 0)
+        {
+            perror("poll");
+            exit(1);
+        }
+
+        if (hittaNow() - lastreport >= BATCHREPORT)
+        {
+            report(start, jobcount);
+            lastreport = hittaNow();
+        }
+    }
+    report(start, jobcount);
+
+    if (output && !(out = fopen(output, "w")))
+    {
+        perror(output);
+        exit(1);
+    }
+
+    /* the lines again, with the names found */
+    for (pos = 0; pos < linecount; ++pos)
+    {
+        ptr = lineNmbr(lines[pos], nmbr);
+        job = strlen(nmbr) < 3 ? 0 : findJob(nmbr);
+        if (!job || !*job->name) fputs(lines[pos], out);
+        else if (!ptr) fprintf(out, "%s\t%s\n", nmbr, job->name);
+        else if (!(ptr = strstr(lines[pos], NAME)) ||
+                 !(end = strchr(ptr + strlen(NAME), '*')))
+            fputs(lines[pos], out);
+        else
+            fprintf(out, "%.*s%s%s", (int) (ptr + strlen(NAME) - lines[pos]),
+                lines[pos], job->name, end);
+        free(lines[pos]);
+    }
+    if (out != stdout && fclose(out) != 0)
+    {
+        perror(output);
+        exit(1);
+    }
+
+    free(lines);
+    free(jobs);
+    hittaCleanup();
+
+    return 0;
+}
@@ -0,0 +1,455 @@
+/*
+ * hittabench.c - This file is part of ncidd.
+ *
+ * LA: measure the hitta.se lookups against hittafixture
+ *
+ * Runs -n lookups of different numbers through hittaAlias(), at most
+ * -c at the same time, with hitta.se moved to the -u url.  The last
+ * digits of the numbers go round the digits of -m, so the fixture
+ * answers with each of its pages in turn.  The cache is not used, and
+ * the lookups run in this process unless -H helpers= is given.
+ *
+ * Reported are the lookups per second, the percentiles of the time
+ * from hittaAlias() to the name, and the allocations made by libcurl
+ * and libxml2 per lookup, counted with curl_global_init_mem() and
+ * xmlMemSetup().  The time of each phase of the lookups, from
+ * hittaStats(), is written to stderr.
+ *
+ * With -S the lookups go on for that many seconds instead, and the RSS
+ * of the process is printed every BENCHSOAKREPORT ms, to see that it
+ * stays flat over a long run, with -H arena=1 or without.
+ *
+ * With -T no lookups are made, hittaTidy() is timed against the split
+ * it replaced, strstr() on SWE_DEST_CODES, over the same numbers.  The
+ * old split misses the codes after the line breaks of the list, so the
+ * numbers it splits differently are counted too.
+ *
+ * usage: hittabench [-n lookups] [-c concurrent] [-u url] [-m digits]
+ *                   [-S seconds] [-T numbers] [-v level] [-H word=value] ...
+ *
+ * ncidd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ncidd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ncidd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ncidd.h"
+#include "hittatool.h"
+#include <ctype.h>
+#include <curl/curl.h>
+#include <libxml/xmlmemory.h>
+
+#define BENCHLOOKUPS    1000
+#define BENCHCONCUR     4
+#define BENCHURL        "http://127.0.0.1:8089/vem-ringde/%s"
+#define BENCHDIGITS     "0123456789"
+#define BENCHSOAKREPORT 10000       /* ms between RSS lines of a soak */
+#define BENCHTIDYROUNDS 10          /* times -T tidies each number */
+
+/* one lookup */
+struct run
+{
+    long started, ms;               /* hittaNow(), and ms to the name */
+    int busy;                       /* being looked up */
+    char name[CIDSIZE];
+};
+
+static struct run *runs;
+static int running, finished, named;
+
+/* allocations by libcurl and libxml2 */
+static unsigned long allocs, frees, allocbytes;
+
+static void *countMalloc(size_t size)
+{
+    ++allocs;
+    allocbytes += size;
+    return malloc(size);
+}
+
+static void *countCalloc(size_t nmemb, size_t size)
+{
+    ++allocs;
+    allocbytes += nmemb * size;
+    return calloc(nmemb, size);
+}
+
+static void *countRealloc(void *ptr, size_t size)
+{
+    if (!ptr) ++allocs;
+    allocbytes += size;
+    return realloc(ptr, size);
+}
+
+static void countFree(void *ptr)
+{
+    if (ptr) ++frees;
+    free(ptr);
+}
+
+static char *countStrdup(const char *str)
+{
+    ++allocs;
+    allocbytes += strlen(str) + 1;
+    return strdup(str);
+}
+
+static void usage(char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [-n lookups] [-c concurrent] [-u url] [-m digits]\n"
+        "       [-S seconds] [-T numbers] [-v level] [-H word=value] ...\n"
+        "  -n  lookups, default %d\n"
+        "  -c  lookups at the same time, default %d\n"
+        "  -u  url of hittafixture, default %s\n"
+        "  -m  last digits of the numbers, default %s\n"
+        "  -S  look up for this many seconds, and print the RSS\n"
+        "  -T  time hittaTidy() against the old split over this many numbers\n"
+        "  -v  log level on stderr, default 1\n"
+        "  -H  lookup option as --hitta in ncidd, repeatable\n",
+        prog, BENCHLOOKUPS, BENCHCONCUR, BENCHURL, BENCHDIGITS);
+    exit(1);
+}
+
+static void benchDone(char *name, void *arg)
+{
+    struct run *run = (struct run *) arg;
+
+    run->ms = hittaNow() - run->started;
+    run->busy = 0;
+    strncpy(run->name, name, CIDSIZE - 1);
+    if (*run->name) ++named;
+    ++finished;
+    --running;
+}
+
+static int compareMs(const void *a, const void *b)
+{
+    long x = *(const long *) a, y = *(const long *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* RSS of this process in KB, 0 if it is not known */
+static long rss()
+{
+    long size, resident = 0;
+    FILE *fp;
+
+    if ((fp = fopen("/proc/self/statm", "r")))
+    {
+        if (fscanf(fp, "%ld %ld", &size, &resident) != 2) resident = 0;
+        fclose(fp);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* the split hittaTidy() replaced, with the digits kept as hittaAlias() did */
+static void oldTidy(char *nmbr)
+{
+    const char *sweDestCodes = SWE_DEST_CODES;
+    char new_nmbr[CIDSIZE];
+    char c, *nmbr_old_ptr = nmbr, *nmbr_new_ptr = nmbr;
+    int i;
+
+    while ((c = *nmbr_old_ptr++))
+        if (isdigit(c))
+            *nmbr_new_ptr++ = c;
+    *nmbr_new_ptr = 0;
+
+    if (nmbr[0] != NATIONAL_PREFX) return;
+    for (i = 3; i > 0; i--)
+    {
+        strcpy(new_nmbr, "-");
+        if (strlen(nmbr) <= (size_t) i) continue;
+        strncat(new_nmbr, nmbr + 1, i);
+        strcat(new_nmbr, "-");
+        if (strstr(sweDestCodes, new_nmbr))
+        {
+            new_nmbr[0] = '0';
+            if (strlen(new_nmbr) == 4 && strlen(nmbr) > 8 && nmbr[1] == '7'
+                && (nmbr[4] != '0' || (nmbr[3] == '0' && nmbr[4] == '0')))
+            {
+                memcpy(&new_nmbr[3], &nmbr[3], 1);
+                strcat(new_nmbr, "-");
+                i++;
+            }
+            strcat(new_nmbr, nmbr + i + 1);
+            strcpy(nmbr, new_nmbr);
+            break;
+        }
+    }
+}
+
+/* ns per call of tidy over count numbers, each BENCHTIDYROUNDS times */
+static double tidyTime(void (*tidy)(char *nmbr), char (*nmbrs)[CIDSIZE],
+                       char (*out)[CIDSIZE], int count)
+{
+    struct timespec start, end;
+    int round, i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (round = 0; round < BENCHTIDYROUNDS; ++round)
+    {
+        for (i = 0; i < count; ++i)
+        {
+            strcpy(out[i], nmbrs[i]);
+            tidy(out[i]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) /
+        ((double) count * BENCHTIDYROUNDS);
+}
+
+/*
+ * time hittaTidy() and the old split over the same count numbers, national
+ * numbers of 7 to 10 digits, some written with blanks and a '-'
+ */
+static void tidyBench(int count)
+{
+    char (*nmbrs)[CIDSIZE], (*newout)[CIDSIZE], (*oldout)[CIDSIZE];
+    double newns, oldns;
+    int i, j, len, differ = 0;
+
+    if (!(nmbrs = calloc(count, CIDSIZE)) || !(newout = calloc(count, CIDSIZE)) ||
+        !(oldout = calloc(count, CIDSIZE)))
+    {
+        perror("calloc");
+        exit(1);
+    }
+
+    srand(1);
+    for (i = 0; i < count; ++i)
+    {
+        len = 7 + rand() % 4;
+        nmbrs[i][0] = NATIONAL_PREFX;
+        nmbrs[i][1] = '1' + rand() % 9;
+        for (j = 2; j < len; ++j) nmbrs[i][j] = '0' + rand() % 10;
+        if (i % 4 == 0)
+        {
+            /* 08-123 45 67 */
+            memmove(nmbrs[i] + 4, nmbrs[i] + 3, len - 3);
+            nmbrs[i][3] = '-';
+            memmove(nmbrs[i] + 8, nmbrs[i] + 7, len - 6);
+            nmbrs[i][7] = ' ';
+        }
+    }
+
+    newns = tidyTime(hittaTidy, nmbrs, newout, count);
+    oldns = tidyTime(oldTidy, nmbrs, oldout, count);
+    for (i = 0; i < count; ++i) if (strcmp(newout[i], oldout[i])) ++differ;
+
+    printf("tidy         %d numbers, %d times each\n", count, BENCHTIDYROUNDS);
+    printf("hittaTidy    %.1f ns per call\n", newns);
+    printf("old split    %.1f ns per call, strstr() on SWE_DEST_CODES\n", oldns);
+    printf("differ       %d numbers split differently\n", differ);
+
+    free(oldout);
+    free(newout);
+    free(nmbrs);
+}
+
+/* look up for seconds, concur at a time, and print the RSS now and then */
+static void soak(int seconds, int concur, char *digits)
+{
+    struct run *run;
+    long start, lastreport;
+    unsigned long next = 0;
+    char nmbr[CIDSIZE];
+
+    start = lastreport = hittaNow();
+    printf("soak         %d s, %d at a time, RSS %ld KB at the start\n",
+        seconds, concur, rss());
+    fflush(stdout);
+
+    while (hittaNow() - start < seconds * 1000L || running)
+    {
+        while (hittaNow() - start < seconds * 1000L && running < concur)
+        {
+            for (run = runs; run->busy; ++run);
+            sprintf(nmbr, "08%06lu%c", next % 1000000,
+                digits[next % strlen(digits)]);
+            ++next;
+            run->started = hittaNow();
+            run->busy = 1;
+            /* not the name of the lookup the run had before */
+            *run->name = 0;
+            ++running;
+            if (!hittaAlias(run->name, nmbr, HITTA_LIVE, benchDone, run))
+                benchDone(run->name, run);
+        }
+        if (toolPoll(1000) < 0)
+        {
+            perror("poll");
+            exit(1);
+        }
+        if (hittaNow() - lastreport >= BENCHSOAKREPORT)
+        {
+            lastreport = hittaNow();
+            printf("soak %6ld s %10d lookups, %d named, RSS %ld KB\n",
+                (lastreport - start) / 1000, finished, named, rss());
+            fflush(stdout);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    char *url = BENCHURL, *digits = BENCHDIGITS, option[BUFSIZ];
+    char nmbr[CIDSIZE];
+    int c, i, next, lookups = BENCHLOOKUPS, concur = BENCHCONCUR, seconds = 0;
+    int tidy = 0;
+    long start, elapsed, *ms;
+    unsigned long startallocs, startbytes;
+
+    /* every lookup goes to the fixture, and errors do not stop it */
+    hittatrip = 0;
+    hittaslow = 0;
+    hittarate = 0;
+    hittahelpers = 0;
+    cachewarm = 0;
+
+    while ((c = getopt(argc, argv, "n:c:u:m:S:T:v:H:")) != -1)
+    {
+        switch (c)
+        {
+            case 'n':
+                if ((lookups = atoi(optarg)) < 1) usage(argv[0]);
+                break;
+            case 'c':
+                concur = atoi(optarg);
+                if (concur < 1 || concur > MAXCONNECT / 2) usage(argv[0]);
+                break;
+            case 'u':
+                url = optarg;
+                break;
+            case 'm':
+                digits = optarg;
+                if (!*digits || strspn(digits, "0123456789") != strlen(digits))
+                    usage(argv[0]);
+                break;
+            case 'S':
+                if ((seconds = atoi(optarg)) < 1) usage(argv[0]);
+                break;
+            case 'T':
+                if ((tidy = atoi(optarg)) < 1) usage(argv[0]);
+                break;
+            case 'v':
+                verbose = atoi(optarg);
+                break;
+            case 'H':
+                if (hittaSet(optarg))
+                {
+                    fprintf(stderr, "Invalid hitta option: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc) usage(argv[0]);
+
+    if (tidy)
+    {
+        tidyBench(tidy);
+        return 0;
+    }
+
+    sprintf(option, "url=hitta=%s", url);
+    if (hittaSet(option) || hittaSet("chain=hitta"))
+    {
+        fprintf(stderr, "Invalid url: %s\n", url);
+        exit(1);
+    }
+
+    /* count before the libraries allocate anything */
+    curl_global_init_mem(CURL_GLOBAL_ALL, countMalloc, countFree,
+        countRealloc, countStrdup, countCalloc);
+    xmlMemSetup(countFree, countMalloc, countRealloc, countStrdup);
+
+    if (seconds) lookups = concur;
+    if (!(runs = (struct run *) calloc(lookups, sizeof(struct run))) ||
+        !(ms = (long *) calloc(lookups, sizeof(long))))
+    {
+        perror("calloc");
+        exit(1);
+    }
+    if (hittaInit())
+    {
+        fprintf(stderr, "Cannot initialize hitta.se lookups\n");
+        exit(1);
+    }
+
+    if (seconds)
+    {
+        soak(seconds, concur, digits);
+        hittaStats();
+        hittaCleanup();
+        curl_global_cleanup();
+        free(ms);
+        free(runs);
+        return 0;
+    }
+
+    startallocs = allocs;
+    startbytes = allocbytes;
+    start = hittaNow();
+    for (next = 0; next < lookups || running; )
+    {
+        while (next < lookups && running < concur)
+        {
+            /* a new number each time, its last digit from -m */
+            sprintf(nmbr, "08%06d%c", next, digits[next % strlen(digits)]);
+            runs[next].started = hittaNow();
+            ++running;
+            if (!hittaAlias(runs[next].name, nmbr, HITTA_LIVE, benchDone,
+                &runs[next]))
+                benchDone(runs[next].name, &runs[next]);
+            ++next;
+        }
+        if (toolPoll(1000) < 0)
+        {
+            perror("poll");
+            exit(1);
+        }
+    }
+    elapsed = hittaNow() - start;
+
+    for (i = 0; i < lookups; ++i) ms[i] = runs[i].ms;
+    qsort(ms, lookups, sizeof(long), compareMs);
+
+    printf("lookups      %d, %d at a time, %d named, %d without a name\n",
+        lookups, concur, named, lookups - named);
+    printf("throughput   %.1f lookups/s in %.2f s\n",
+        elapsed > 0 ? lookups * 1000.0 / elapsed : 0.0, elapsed / 1000.0);
+    printf("latency ms   p50 %ld  p90 %ld  p99 %ld  max %ld\n",
+        ms[lookups * 50 / 100], ms[lookups * 90 / 100],
+        ms[lookups * 99 / 100], ms[lookups - 1]);
+    printf("allocations  %.1f per lookup, %.0f bytes per lookup\n",
+        (double) (allocs - startallocs) / lookups,
+        (double) (allocbytes - startbytes) / lookups);
+    fflush(stdout);
+
+    /* the time of each phase, on stderr */
+    hittaStats();
+
+    hittaCleanup();
+    curl_global_cleanup();
+    printf("not freed    %ld allocations\n", (long) (allocs - frees));
+
+    free(ms);
+    free(runs);
+
+    return 0;
+}
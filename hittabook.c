@@ -0,0 +1,76 @@
+/*
+ * hittabook.c - This file is part of ncidd.
+ *
+ * LA: make the phonebook file ncidd looks in before hitta.se
+ *
+ * The list is read from a file or stdin, a line is a number, a tab or
+ * a ';', and the name.  The numbers are made tidy as hittaAlias() does,
+ * and of a number listed more than once the last name is kept.  The new
+ * phonebook is renamed over the old one when it is complete, a running
+ * ncidd maps it within BOOKCHECK seconds.
+ *
+ * usage: hittabook [-o phonebook] [list]
+ *
+ * ncidd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ncidd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ncidd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ncidd.h"
+#include "hittatool.h"
+#include "nciddbook.h"
+
+static void usage(char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [-o phonebook] [list]\n"
+        "  -o  phonebook file, default %s\n"
+        "  list has a number, a tab or a ';', and a name on each line\n",
+        prog, BOOKFILE);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    char *output = bookfile;
+    int c, count;
+    FILE *in = stdin;
+
+    while ((c = getopt(argc, argv, "o:")) != -1)
+    {
+        switch (c)
+        {
+            case 'o':
+                output = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind < argc - 1) usage(argv[0]);
+    if (optind == argc - 1 && !(in = fopen(argv[optind], "r")))
+    {
+        perror(argv[optind]);
+        exit(1);
+    }
+
+    if ((count = bookBuild(in, output, hittaTidy)) < 0)
+    {
+        perror(output);
+        exit(1);
+    }
+    if (in != stdin) fclose(in);
+
+    fprintf(stderr, "%s: %d numbers\n", output, count);
+
+    return 0;
+}
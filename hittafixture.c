@@ -0,0 +1,433 @@
+/*
+ * hittafixture.c - This file is part of ncidd.
+ *
+ * LA: a stand-in for hitta.se, so the lookups can be measured offline
+ *
+ * Serves the pages in the fixtures directory for /vem-ringde/<number>,
+ * with keep-alive.  The last digit of the number picks the page:
+ *
+ *   0 person.html      XPath 1, one person
+ *   1 persons.html     XPath 2, many persons
+ *   2 company.html     XPath 3, one company
+ *   3 companies.html   XPath 4, many companies
+ *   4 unknown.html     XPath 5, Okänt nummer
+ *   5 nomatch.html     a page without a name
+ *   6 404 Not Found
+ *   7 500 Internal Server Error
+ *   8 person.html cut off in the middle, then the connection is closed
+ *   9 person.html
+ *
+ * The answer is sent after -l ms plus up to -J ms more.  With -f a
+ * percent of the requests fail: half get 503, half a closed connection.
+ * With -s the <!--pad--> in each page is replaced by that many KB, as
+ * the scripts and styles in the head of a real page.  With -z a request
+ * that accepts gzip gets the page gzip compressed, as hitta.se does.
+ *
+ * usage: hittafixture [-p port] [-d dir] [-l ms] [-J ms] [-f percent]
+ *                     [-s KB] [-z]
+ *
+ * ncidd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ncidd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ncidd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ncidd.h"
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <signal.h>
+#include <zlib.h>
+
+#define FIXTUREPORT     8089
+#define FIXTUREDIR      "fixtures"
+#define FIXTURECONN     64          /* connections at the same time */
+#define FIXTUREPAD      "<!--pad-->"
+
+static char *pageFile[] = {"person.html", "persons.html", "company.html",
+    "companies.html", "unknown.html", "nomatch.html", 0};
+
+static struct page
+{
+    char *data;
+    size_t len;
+    char *gz;                       /* data gzip compressed, with -z */
+    size_t gzlen;
+} page[6];
+
+static struct conn
+{
+    int fd;
+    char in[BUFSIZ];
+    size_t inlen;
+    char *out;                      /* answer, sent from outpos */
+    size_t outlen, outpos;
+    long sendat;                    /* ms, when the answer may be sent */
+    int closeafter;                 /* close when the answer is sent */
+} conn[FIXTURECONN];
+
+static struct pollfd pfd[FIXTURECONN + 1];
+static int latency, jitter, failpct, gzip;
+static unsigned long requests, failed;
+
+static long now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+static void usage(char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [-p port] [-d dir] [-l ms] [-J ms] [-f percent] [-s KB]\n"
+        "       [-z]\n"
+        "  -p  port on 127.0.0.1, default %d\n"
+        "  -d  directory with the pages, default %s\n"
+        "  -l  ms before each answer\n"
+        "  -J  up to this many ms more, at random\n"
+        "  -f  percent of the requests that fail\n"
+        "  -s  KB put in place of %s in each page\n"
+        "  -z  gzip the pages for requests that accept it\n",
+        prog, FIXTUREPORT, FIXTUREDIR, FIXTUREPAD);
+    exit(1);
+}
+
+/* read a page, with pad KB of filler in place of FIXTUREPAD */
+static int readPage(char *dir, char *file, int pad, struct page *pp)
+{
+    char path[BUFSIZ], *buf, *mark;
+    struct stat statbuf;
+    size_t padlen = (size_t) pad * 1024, i;
+    FILE *fp;
+
+    sprintf(path, "%s/%s", dir, file);
+    if (!(fp = fopen(path, "r")) || fstat(fileno(fp), &statbuf) < 0)
+    {
+        perror(path);
+        return -1;
+    }
+    if (!(buf = malloc(statbuf.st_size + 1)) ||
+        !(pp->data = malloc(statbuf.st_size + padlen + 1)))
+    {
+        perror("malloc");
+        return -1;
+    }
+    if (fread(buf, 1, statbuf.st_size, fp) != (size_t) statbuf.st_size)
+    {
+        perror(path);
+        return -1;
+    }
+    fclose(fp);
+    buf[statbuf.st_size] = 0;
+
+    if (!(mark = strstr(buf, FIXTUREPAD)))
+    {
+        strcpy(pp->data, buf);
+        pp->len = statbuf.st_size;
+    }
+    else
+    {
+        pp->len = mark - buf;
+        memcpy(pp->data, buf, pp->len);
+        for (i = 0; i < padlen; ++i)
+            pp->data[pp->len++] = i % 64 == 63 ? '\n' : 'a' + i % 26;
+        strcpy(pp->data + pp->len, mark + strlen(FIXTUREPAD));
+        pp->len += strlen(mark + strlen(FIXTUREPAD));
+    }
+    free(buf);
+
+    return 0;
+}
+
+/* the page gzip compressed, as Content-Encoding: gzip */
+static int gzipPage(struct page *pp)
+{
+    z_stream zs;
+
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+        Z_DEFAULT_STRATEGY) != Z_OK) return -1;
+    pp->gzlen = deflateBound(&zs, pp->len);
+    if (!(pp->gz = malloc(pp->gzlen)))
+    {
+        deflateEnd(&zs);
+        return -1;
+    }
+    zs.next_in = (Bytef *) pp->data;
+    zs.avail_in = pp->len;
+    zs.next_out = (Bytef *) pp->gz;
+    zs.avail_out = pp->gzlen;
+    if (deflate(&zs, Z_FINISH) != Z_STREAM_END)
+    {
+        deflateEnd(&zs);
+        return -1;
+    }
+    pp->gzlen = zs.total_out;
+    deflateEnd(&zs);
+
+    return 0;
+}
+
+/* the answer to a request for path, gz if it accepts gzip */
+static void answer(struct conn *cp, char *path, int gz)
+{
+    char head[BUFSIZ], *nmbr, *data = 0, *status = "200 OK";
+    struct page *pp = 0;
+    size_t len = 0, cut = 0;
+    int digit = -1;
+
+    ++requests;
+    cp->closeafter = 0;
+    cp->sendat = now() + latency + (jitter ? rand() % (jitter + 1) : 0);
+
+    if (!strncmp(path, "/vem-ringde/", 12) && *(nmbr = path + 12))
+    {
+        digit = nmbr[strlen(nmbr) - 1] - '0';
+        if (digit < 0 || digit > 9) digit = -1;
+    }
+
+    if (failpct && rand() % 100 < failpct)
+    {
+        ++failed;
+        if (rand() % 2)
+        {
+            /* nothing at all */
+            cp->closeafter = 1;
+            cp->outlen = cp->outpos = 0;
+            return;
+        }
+        status = "503 Service Unavailable";
+    }
+    else if (digit < 0 || digit == 6) status = "404 Not Found";
+    else if (digit == 7) status = "500 Internal Server Error";
+    else if (digit == 8 || digit == 9) pp = &page[0];
+    else pp = &page[digit];
+
+    if (pp && gz && pp->gz)
+    {
+        data = pp->gz;
+        len = pp->gzlen;
+    }
+    else if (pp)
+    {
+        data = pp->data;
+        len = pp->len;
+    }
+    if (digit == 8 && pp)
+    {
+        /* Content-Length for all of it, but only half is sent */
+        cut = len / 2;
+        cp->closeafter = 1;
+    }
+
+    sprintf(head, "HTTP/1.1 %s\r\nContent-Type: text/html; charset=utf-8\r\n"
+        "%sContent-Length: %lu\r\n\r\n", status,
+        data && data == pp->gz ? "Content-Encoding: gzip\r\n" : "",
+        (unsigned long) len);
+
+    free(cp->out);
+    if (cut) len = cut;
+    if (!(cp->out = malloc(strlen(head) + len)))
+    {
+        cp->outlen = cp->outpos = 0;
+        cp->closeafter = 1;
+        return;
+    }
+    memcpy(cp->out, head, strlen(head));
+    if (data) memcpy(cp->out + strlen(head), data, len);
+    cp->outlen = strlen(head) + len;
+    cp->outpos = 0;
+}
+
+static void closeConn(struct conn *cp)
+{
+    close(cp->fd);
+    free(cp->out);
+    memset(cp, 0, sizeof(struct conn));
+    cp->fd = -1;
+}
+
+/* read a request, the next is read when its answer is sent */
+static void readConn(struct conn *cp)
+{
+    char *end, *sp, *ep, *ae;
+    ssize_t n;
+    int gz;
+
+    n = read(cp->fd, cp->in + cp->inlen, sizeof(cp->in) - cp->inlen - 1);
+    if (n <= 0)
+    {
+        closeConn(cp);
+        return;
+    }
+    cp->inlen += n;
+    cp->in[cp->inlen] = 0;
+    if (!(end = strstr(cp->in, "\r\n\r\n")))
+    {
+        if (cp->inlen == sizeof(cp->in) - 1) closeConn(cp);
+        return;
+    }
+
+    /* gzip in the Accept-Encoding: of this request */
+    *end = 0;
+    gz = 0;
+    if ((ae = strstr(cp->in, "\r\nAccept-Encoding:")))
+    {
+        if ((ep = strstr(ae += 2, "\r\n"))) *ep = 0;
+        gz = strstr(ae, "gzip") != 0;
+        if (ep) *ep = '\r';
+    }
+
+    /* GET <path> HTTP/1.1 */
+    if (!(sp = strchr(cp->in, ' ')) || !(ep = strchr(++sp, ' ')))
+    {
+        closeConn(cp);
+        return;
+    }
+    *ep = 0;
+    answer(cp, sp, gz);
+
+    end += 4;
+    cp->inlen -= end - cp->in;
+    memmove(cp->in, end, cp->inlen);
+}
+
+static void writeConn(struct conn *cp)
+{
+    ssize_t n;
+
+    if (cp->outpos < cp->outlen)
+    {
+        n = write(cp->fd, cp->out + cp->outpos, cp->outlen - cp->outpos);
+        if (n < 0)
+        {
+            if (errno != EAGAIN) closeConn(cp);
+            return;
+        }
+        cp->outpos += n;
+    }
+    if (cp->outpos < cp->outlen) return;
+
+    free(cp->out);
+    cp->out = 0;
+    cp->outlen = cp->outpos = 0;
+    if (cp->closeafter) closeConn(cp);
+}
+
+static void report(int sig)
+{
+    fprintf(stderr, "hittafixture: %lu requests, %lu failed on purpose\n",
+        requests, failed);
+    if (sig == SIGTERM || sig == SIGINT) exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+    struct sockaddr_in addr;
+    char *dir = FIXTUREDIR;
+    int c, i, sd, fd, on = 1, port = FIXTUREPORT, pad = 0, timeout;
+    long t;
+
+    while ((c = getopt(argc, argv, "p:d:l:J:f:s:z")) != -1)
+    {
+        switch (c)
+        {
+            case 'p': port = atoi(optarg); break;
+            case 'd': dir = optarg; break;
+            case 'l': latency = atoi(optarg); break;
+            case 'J': jitter = atoi(optarg); break;
+            case 'f': failpct = atoi(optarg); break;
+            case 's': pad = atoi(optarg); break;
+            case 'z': gzip = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind != argc || latency < 0 || jitter < 0 || failpct < 0 ||
+        failpct > 100 || pad < 0) usage(argv[0]);
+
+    for (i = 0; pageFile[i]; ++i)
+    {
+        if (readPage(dir, pageFile[i], pad, &page[i])) exit(1);
+        if (gzip && gzipPage(&page[i]))
+        {
+            fprintf(stderr, "Cannot gzip %s\n", pageFile[i]);
+            exit(1);
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGTERM, report);
+    signal(SIGINT, report);
+    signal(SIGUSR1, report);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((sd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+        setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+        bind(sd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        listen(sd, FIXTURECONN) < 0)
+    {
+        perror("socket");
+        exit(1);
+    }
+    for (i = 0; i < FIXTURECONN; ++i) conn[i].fd = -1;
+
+    while (1)
+    {
+        /* the listen socket, then a slot for each connection */
+        t = now();
+        timeout = -1;
+        pfd[0].fd = sd;
+        pfd[0].events = POLLIN;
+        for (i = 0; i < FIXTURECONN; ++i)
+        {
+            pfd[i + 1].fd = conn[i].fd;
+            pfd[i + 1].events = 0;
+            if (conn[i].fd < 0) continue;
+            if (conn[i].outlen || conn[i].closeafter)
+            {
+                /* an answer waits for its time */
+                if (conn[i].sendat <= t) pfd[i + 1].events = POLLOUT;
+                else if (timeout < 0 || conn[i].sendat - t < timeout)
+                    timeout = (int) (conn[i].sendat - t);
+            }
+            else pfd[i + 1].events = POLLIN;
+        }
+
+        if (poll(pfd, FIXTURECONN + 1, timeout) < 0)
+        {
+            if (errno == EINTR) continue;
+            perror("poll");
+            exit(1);
+        }
+
+        if (pfd[0].revents & POLLIN && (fd = accept(sd, 0, 0)) >= 0)
+        {
+            for (i = 0; i < FIXTURECONN && conn[i].fd >= 0; ++i);
+            if (i == FIXTURECONN) close(fd);
+            else
+            {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                conn[i].fd = fd;
+            }
+        }
+        for (i = 0; i < FIXTURECONN; ++i)
+        {
+            if (conn[i].fd < 0 || pfd[i + 1].fd != conn[i].fd) continue;
+            if (pfd[i + 1].revents & POLLOUT) writeConn(&conn[i]);
+            else if (pfd[i + 1].revents & (POLLIN | POLLHUP | POLLERR))
+                readConn(&conn[i]);
+        }
+    }
+}
@@ -0,0 +1,64 @@
+/*
+ * hittatool.c - This file is part of ncidd.
+ *
+ * LA: what the hitta.se lookup code needs from ncidd, for the tools
+ * that use it without ncidd: the call log name and the log functions,
+ * which write to stderr, and a poll loop over nciddpoll.c.
+ *
+ * ncidd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ncidd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ncidd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ncidd.h"
+#include "hittatool.h"
+#include "nciddpoll.h"
+
+char *cidlog = CIDLOG;
+int verbose = 1;
+
+char *strdate(int separator)
+{
+    static char buf[BUFSIZ];
+    struct tm *tm;
+    time_t t = time(0);
+
+    tm = localtime(&t);
+    sprintf(buf, "%.2d:%.2d:%.2d",  tm->tm_hour, tm->tm_min, tm->tm_sec);
+    return buf;
+}
+
+void logMsg(int level, char *message)
+{
+    if (verbose >= level) fputs(message, stderr);
+}
+
+/*
+ * wait for the lookup sockets at most timeout ms, and run the lookups
+ * returns -1 if poll() failed
+ */
+int toolPoll(int timeout)
+{
+    int events, i, pos;
+
+    if ((events = waitPoll(hittaTimeout(timeout))) < 0 && errno != EINTR)
+        return -1;
+    for (i = 0; i < events; ++i)
+    {
+        pos = pollready[i];
+        if (hittaSocket(pos)) hittaEvent(pos, polld[pos].revents);
+        polld[pos].revents = 0;
+    }
+    hittaTimer();
+
+    return 0;
+}
@@ -0,0 +1,27 @@
+/*
+ * hittatool.h - This file is part of ncidd.
+ *
+ * LA: ncidd parts for the tools that use the hitta.se lookup code
+ *
+ * ncidd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ncidd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ncidd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nciddhitta.h"
+#include "nciddcache.h"
+
+/* log level written to stderr */
+extern int verbose;
+
+extern char *strdate(int separator);
+extern int  toolPoll(int timeout);
@@ -18,7 +18,16 @@
  * along with ncidd.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+/* LA: accept4() */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "ncidd.h"
+#include "nciddhitta.h"
+#include "nciddpoll.h"
+#include <netinet/tcp.h>
+#include <sys/resource.h>
 
 /* globals */
 char *cidlog   = CIDLOG;
@@ -45,17 +54,64 @@ char tmpHostName[MAXIPBUF];
 char infoline[CIDSIZE] = ONELINE;
 char modembuf[BUFSIZ];
 
-struct pollfd polld[MAXCONNECT];
 struct termios otty, rtty, ntty;
 FILE *logptr;
 
-struct ipinfo {
+/*
+ * LA: client[pos] is for same client/gateway as in polld[pos], which
+ * has its fd; the table grows with polld[], see pollTable()
+ */
+struct client {
+    int ack;
+    time_t connected;       /* 0 if polld[pos] is not a client */
+    time_t lastread;        /* when it last sent something */
+    unsigned long bytesin, bytesout;
+    unsigned long drops;    /* writes dropped, its queue was full */
+    char *out;              /* output queue, out + outhead to out + outlen */
+    size_t outhead, outlen, outsize;
     char addr[MAXIPBUF];
     char name[MAXIPBUF];
-} IPinfo[MAXCONNECT];
+} *client;
+
+/* LA: clients connected now, at most maxclients */
+int clients;
+
+/* LA: clients, from --maxclients */
+#define CLIENTMAX 1024
+
+/* LA: seconds a client connection is idle before TCP keepalive probes
+   start, then a probe every CLIENTPROBE s and at most CLIENTPROBES
+   unanswered until the connection fails and the slot is freed;
+   --keepalive 0 leaves the system defaults */
+#define CLIENTIDLE 600
+#define CLIENTPROBE 30
+#define CLIENTPROBES 4
+
+int maxclients = CLIENTMAX, keepalive = CLIENTIDLE;
+
+/*
+ * LA: the slot of the server socket, a descriptor kept to accept and
+ * close a client when there is no other, and 1 while the server socket
+ * is out of poll() until a client closes
+ */
+int mainpos, sparefd = -1, acceptoff;
+
+/*
+ * LA: bytes a client's output queue may hold, what the socket does not
+ * take at once waits there for POLLOUT; the call log sent when a client
+ * connects goes through it too, so it should be larger than cidlogmax
+ */
+#define CLIENTQUEUE 1048576
+
+/* LA: what --slowclient does when a write does not fit in the queue */
+#define SLOWCLOSE 0     /* close the client, it can connect again */
+#define SLOWDROP 1      /* drop the write, the client misses it */
 
-/* ack[pos] is for same client/gateway as in polld[pos] */
-int ack[MAXCONNECT]; /* only for clients */
+int clientqueue = CLIENTQUEUE, slowclient = SLOWCLOSE;
+
+/* LA: bytes in the output queues now and in all, dropped writes, and
+   clients closed for a full queue */
+unsigned long outqueued, outtotal, outdropped, outevicted;
 
 struct cid
 {
@@ -68,6 +124,54 @@ struct cid
     char cidline[CIDSIZE];
 } cid = {0, "", "", "", "", NOMESG, ONELINE};
 
+/*
+ * LA: a call record parked until its hitta.se name lookup finishes
+ *
+ * ready: 0 while the call is received, 1 when the call is complete
+ * and only waits for the name, 2 when the call was sent without the
+ * name after hittawait ms, -1 if the call was dropped
+ */
+struct park
+{
+    int ready;
+    int done;
+    int calltype;
+    long deadline;          /* hittaNow() when the call is sent anyway */
+    struct cid cid;
+    struct park *next;      /* on the waiting list if ready is 1 */
+    char line[BUFSIZ];      /* call line logged if ready is 2 */
+} *parked,  /* call being received with a lookup started */
+  *waiting; /* complete calls waiting for a name, oldest first */
+
+/* LA: bytes at the end of cidcall.log searched for a call to update */
+#define PATCHTAIL 65536
+
+/*
+ * LA: a REQ: LOOKUP <nmbr> from a client, answered from the poll() loop
+ * when hitta.se has the name; fd is 0 if the client went away first
+ */
+#define LOOKUP_REQ "LOOKUP"
+
+struct ask
+{
+    int pos;
+    int fd;
+    char nmbr[CIDSIZE];
+    char name[CIDSIZE];
+    struct ask *next;
+} *asked;   /* lookups started for clients */
+
+/*
+ * LA: the names the aliases in ncidd.alias give, read once when the
+ * hitta.se cache is seeded from cidcall.log, so warmName() can tell
+ * an alias there from a hitta.se name
+ */
+struct target
+{
+    char name[CIDSIZE];
+    struct target *next;
+} *targets;
+
 struct mesg
 {
     char date[CIDSIZE];
@@ -201,20 +305,25 @@ void exit(), finish(), free(), reload(), ignore(), doPoll(), formatCID(),
      update_cidcall_log(), getINFO(), getField(), hexdump(), checkModem(),
      normalExit(), showConnected();
 
-/* LA Added function */
-void sendMsg();
+/* LA Added functions */
+void sendMsg(), sendCID(), startLookup(), dropLookup(), lookupDone(),
+     newClient(), dropClient(), flushClient(),
+     waitLookup(), parkTimer(), sendUpdate(), patchLog(), startAsk(),
+     askDone(), sendAsk(), dropAsks(), readTargets();
+int parkTimeout(), clientWrite(), slowClient(), warmName(), refuseClient();
 
 int getOptions(), doConf(), errorExit(), doAlias(), doTTY(), CheckForLockfile(),
-    addPoll(), tcpOpen(), doModem(), initModem(), gettimeofday(), doPID(),
+    tcpOpen(), doModem(), initModem(), gettimeofday(), doPID(),
     tcpAccept(), openTTY();
 
 char *trimWhitespace();
 
 int main(int argc, char *argv[])
 {
-    int events, argind, i, fd, errnum, ret;
+    int events, argind, i, fd, errnum, ret, timeout;
     char *ptr;
     struct stat statbuf;
+    struct rlimit files;
     struct utsname utsbuf;
     char msgbuf[BUFSIZ];
 
@@ -424,8 +533,11 @@ int main(int argc, char *argv[])
     strncpy(cid.cidline, lineid, CIDSIZE - 1);
     strncpy(infoline, lineid, CIDSIZE - 1);
 
-    sprintf(msgbuf, "Maximum number of clients/gateways: %d\n",
-            noserial ? MAXCLIENTS + 1 : MAXCLIENTS);
+    sprintf(msgbuf, "Maximum number of clients/gateways: %d\n", maxclients);
+    logMsg(LEVEL1, msgbuf);
+
+    sprintf(msgbuf, "Client output queue: %d bytes, --slowclient %s\n",
+            clientqueue, slowclient == SLOWDROP ? "drop" : "close");
     logMsg(LEVEL1, msgbuf);
 
     sprintf(msgbuf, "Telephone Line Identifier: %s\n", lineid);
@@ -599,6 +711,21 @@ int main(int argc, char *argv[])
         errorExit(-110, "Fatal", msgbuf);
     }
 
+    /*
+     * LA: the poll table grows to maxclients clients, with room for the
+     * tty, the server socket and the hitta.se lookups, and ncidd may
+     * need that many files and a few more
+     */
+    pollmax = maxclients + MAXCONNECT;
+    if (pollTable(&client, sizeof(struct client))) errorExit(-1, name, 0);
+    if (!getrlimit(RLIMIT_NOFILE, &files) &&
+        files.rlim_cur < (rlim_t) pollmax + 16)
+    {
+        files.rlim_cur = (rlim_t) pollmax + 16;
+        if (files.rlim_cur > files.rlim_max) files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
     if (!noserial) {
             pollpos = addPoll(ttyfd);
             sprintf(msgbuf,"%s is fd %d\n",
@@ -609,20 +736,33 @@ int main(int argc, char *argv[])
     /* initialize server socket */
     if ((mainsock = tcpOpen()) < 0) errorExit(-1, "socket", 0);
 
-    ret = addPoll(mainsock);
-    sprintf(msgbuf,"NCID connection socket is sd %d pos %d\n", mainsock, ret);
+    mainpos = addPoll(mainsock);
+    sprintf(msgbuf,"NCID connection socket is sd %d pos %d\n", mainsock, mainpos);
     logMsg(LEVEL3, msgbuf);
+    sparefd = open("/dev/null", O_RDONLY);
+
+    /* LA: hitta.se lookups run from the poll() loop */
+    hittawarmname = warmName;
+    if (hittaInit())
+        errorExit(-115, "Fatal", "Cannot initialize hitta.se lookups");
 
     /* Read and display data */
     while (1)
     {
-        switch (events = poll(polld, MAXCONNECT, TIMEOUT))
+        timeout = hittaTimeout(parkTimeout(TIMEOUT));
+        switch (events = waitPoll(timeout))
         {
             case -1:    /* error */
                 if (errno != EINTR) /* No error for SIGHUP */
                     errorExit(-1, "poll", 0);
                 break;
             case 0:        /* time out, without an event */
+                /* a lookup or call timer expired, not a server time out */
+                if (timeout < TIMEOUT) break;
+
+                /* LA: idle, look up names called often before they expire */
+                hittaRefresh();
+
                 if (ring > 0)
                 {
                     /* ringing detected  */
@@ -670,10 +810,8 @@ int main(int argc, char *argv[])
 
                             /* save TTY events */
                             pollevents = polld[pollpos].events;
-                            /* remove TTY poll events */
-                            polld[pollpos].events = polld[pollpos].revents = 0;
-                            polld[pollpos].fd = 0;
-                            close(ttyfd);
+                            /* remove TTY from the poll table */
+                            closePoll(pollpos);
                             ttyfd = 0;
                             sprintf(msgbuf, "TTY in use: releasing modem %s\n",
                                 strdate(WITHSEP));
@@ -700,8 +838,9 @@ int main(int argc, char *argv[])
                         }
                         locked = 0;
                         /* restore tty poll events */
-                        polld[pollpos].fd = ttyfd;
-                        polld[pollpos].events = pollevents;
+                        if ((pollpos = addPoll(ttyfd)) < 0)
+                            errorExit(-110, "Fatal", "No poll slot for TTY");
+                        setPoll(pollpos, pollevents);
                     }
                 }
                 break;
@@ -709,6 +848,12 @@ int main(int argc, char *argv[])
                 doPoll(events);
                 break;
         }
+
+        /* run any hitta.se lookups with an expired timer */
+        hittaTimer();
+
+        /* send calls that waited too long for their name */
+        parkTimer();
     }
 }
 
@@ -724,22 +869,27 @@ int getOptions(int argc, char *argv[])
         {"config", 1, 0, 'C'},
         {"cidlog", 1, 0, 'c'},
         {"cidlogmax", 1, 0, 'M'},
+        {"clientqueue", 1, 0, 'Q'},
         {"datalog", 1, 0, 'd'},
         {"debug", 0, 0, 'D'},
         {"gencid", 1, 0, 'g'},
         {"help", 0, 0, 'h'},
         {"hangup", 1, 0, 'H'},
+        {"hitta", 1, 0, 'X'},
         {"initcid", 1, 0, 'i'},
         {"initstr", 1, 0, 'I'},
         {"lineid", 1, 0, 'e'},
+        {"keepalive", 1, 0, 'K'},
         {"lockfile", 1, 0, 'l'},
         {"logfile", 1, 0, 'L'},
+        {"maxclients", 1, 0, 'm'},
         {"nomodem", 1, 0, 'n'},
         {"noserial", 1, 0, 'N'},
         {"pidfile", 1, 0, 'P'},
         {"port", 1, 0, 'p'},
         {"regex", 1, 0, 'r'},
         {"send", 1, 0, 's'},
+        {"slowclient", 1, 0, 'O'},
         {"ttyspeed", 1, 0, 'S'},
         {"ttyclocal", 1, 0, 'T'},
         {"ttyport", 1, 0, 't'},
@@ -751,7 +901,7 @@ int getOptions(int argc, char *argv[])
         {0, 0, 0, 0}
     };
 
-    while ((c = getopt_long (argc, argv, "a:c:d:e:f:g:hi:l:n:p:r:s:t:v:A:B:C:DH:I:L:M:N:P:S:T:VW:",
+    while ((c = getopt_long (argc, argv, "a:c:d:e:f:g:hi:l:m:n:p:r:s:t:v:A:B:C:DH:I:K:L:M:N:O:P:Q:S:T:VW:X:",
         long_options, &option_index)) != -1)
     {
         switch (c)
@@ -832,6 +982,30 @@ int getOptions(int argc, char *argv[])
                 if (!(whitelist = strdup(optarg))) errorExit(-1, name, 0);
                 if ((num = findWord("whitelist")) >= 0) setword[num].type = 0;
                 break;
+            case 'K': /* LA: seconds before keepalive probes, 0 for none */
+                keepalive = atoi(optarg);
+                if (strspn(optarg, "0123456789") != strlen(optarg))
+                    errorExit(-107, "Invalid number", optarg);
+                break;
+            case 'm': /* LA: clients/gateways connected at the same time */
+                maxclients = atoi(optarg);
+                if (maxclients < 1 || strspn(optarg, "0123456789") != strlen(optarg))
+                    errorExit(-107, "Invalid number", optarg);
+                break;
+            case 'O': /* LA: close or drop, for a client that is too slow */
+                if (!strcmp(optarg, "close")) slowclient = SLOWCLOSE;
+                else if (!strcmp(optarg, "drop")) slowclient = SLOWDROP;
+                else errorExit(-107, "Invalid slowclient", optarg);
+                break;
+            case 'Q': /* LA: bytes queued for a client at most */
+                clientqueue = atoi(optarg);
+                if (clientqueue < BUFSIZ || strspn(optarg, "0123456789") != strlen(optarg))
+                    errorExit(-107, "Invalid number", optarg);
+                break;
+            case 'X': /* LA: hitta.se lookup option word=value */
+                if (hittaSet(optarg))
+                    errorExit(-107, "Invalid hitta option", optarg);
+                break;
             case 'a':
                 if (!(announce = strdup(optarg))) errorExit(-1, name, 0);
                 if ((num = findWord("announce")) >= 0) setword[num].type = 0;
@@ -1379,7 +1553,14 @@ int tcpOpen()
         close(sd);
         return ret;
     }
-    if ((ret = listen(sd, MAXCONNECT)) < 0)
+    /* LA: as many waiting clients as the system allows */
+    if ((ret = listen(sd, SOMAXCONN)) < 0)
+    {
+        close(sd);
+        return ret;
+    }
+    /* LA: doPoll() accepts until no client is waiting */
+    if ((ret = fcntl(sd, F_SETFL, O_NONBLOCK)) < 0)
     {
         close(sd);
         return ret;
@@ -1396,7 +1577,18 @@ int tcpAccept()
     struct  sockaddr_in sa;
     unsigned int sa_len = sizeof(sa);
 
-    if ((sd = accept(mainsock, (struct sockaddr *) &sa, &sa_len)) != -1)
+    /* LA: the client socket is non-blocking */
+#ifdef HAVE_EPOLL
+    sd = accept4(mainsock, (struct sockaddr *) &sa, &sa_len, SOCK_NONBLOCK);
+#else
+    if ((sd = accept(mainsock, (struct sockaddr *) &sa, &sa_len)) != -1 &&
+        fcntl(sd, F_SETFL, O_NONBLOCK) < 0)
+    {
+        close(sd);
+        sd = -1;
+    }
+#endif
+    if (sd != -1)
     {
         strcpy(tmpIPaddr, inet_ntoa(sa.sin_addr));
         ret = getnameinfo((struct sockaddr *) &sa, sa_len, tmpbuf, sizeof(tmpbuf), NULL, 0, 0);
@@ -1411,27 +1603,298 @@ int tcpAccept()
     return sd;
 }
 
-int addPoll(int pollfd)
+/*
+ * LA: a client connected, sd is non-blocking; it gets the startup
+ * messages, or is told there are too many clients and closed
+ */
+
+void newClient(int sd)
+{
+    int pos, ret, optval;
+    char buf[BUFSIZ], msgbuf[BUFSIZ];
+
+    (void) ret;
+
+    if (clients >= maxclients || (pos = addPoll(sd)) < 0)
+    {
+        sprintf(msgbuf, "Client trying to connect.\n");
+        logMsg(LEVEL1, msgbuf);
+        sprintf(msgbuf, NOLOGSENT NL);
+        logMsg(LEVEL1, msgbuf);
+        sprintf(msgbuf, TOOMSG, maxclients, strdate(WITHSEP), NL);
+        logMsg(LEVEL1, msgbuf);
+        sprintf(buf, NOLOGSENT CRLF);
+        ret = write(sd, buf, strlen(buf));
+        sprintf(buf, TOOMSG, maxclients, strdate(WITHSEP), CRLF);
+        ret = write(sd, buf, strlen(buf));
+        close(sd);
+        return;
+    }
+
+    ++clients;
+    memset(&client[pos], 0, sizeof(struct client));
+    client[pos].connected = client[pos].lastread = time(0);
+    strcpy(client[pos].addr, tmpIPaddr);
+    strcpy(client[pos].name, tmpHostName);
+    sprintf(msgbuf, "Client %d pos %d from %s%s connected %s\n", 
+            sd, pos, client[pos].addr, client[pos].name, strdate(WITHSEP));
+    logMsg(LEVEL2, msgbuf);
+
+    /* a client that went away without closing is found by keepalive */
+#ifdef TCP_KEEPIDLE
+    if (keepalive)
+    {
+        optval = keepalive;
+        setsockopt(sd, IPPROTO_TCP, TCP_KEEPIDLE, &optval, sizeof(optval));
+        optval = CLIENTPROBE;
+        setsockopt(sd, IPPROTO_TCP, TCP_KEEPINTVL, &optval, sizeof(optval));
+        optval = CLIENTPROBES;
+        setsockopt(sd, IPPROTO_TCP, TCP_KEEPCNT, &optval, sizeof(optval));
+    }
+#endif
+    optval = 1;
+    setsockopt(sd, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof(optval));
+
+    sprintf(buf, "%s %s %s%s", ANNOUNCE, name, VERSION, CRLF);
+    ret = clientWrite(pos, buf, strlen(buf));
+    sprintf(buf, "%s %s %s\n", ANNOUNCE, name, VERSION);
+    logMsg(LEVEL3, buf);
+
+    sprintf(buf, "%s%s%s", APIANNOUNCE, API, CRLF);
+    ret = clientWrite(pos, buf, strlen(buf));
+    sprintf(buf, "%s%s\n", APIANNOUNCE, API);
+    logMsg(LEVEL3, buf);
+
+    if (sendlog)
+    {
+        sendLog(pos, buf);
+    }
+    else
+    {
+        /* CID log not sent */
+        sprintf(msgbuf, "%s%s", NOLOGSENT, CRLF);
+        ret = clientWrite(pos, msgbuf, strlen(msgbuf));
+        sprintf(msgbuf, "Call log not sent: %s\n", cidlog);
+        logMsg(LEVEL3, msgbuf);
+    }
+    if (hangup)
+    { 
+        sprintf (msgbuf, OPTLINE "hangup" CRLF);
+        ret = clientWrite (pos, msgbuf, strlen(msgbuf));
+        sprintf(msgbuf, "Sent 'hangup' option to client\n");
+        logMsg(LEVEL3, msgbuf);
+    }
+    /* End of startup messages */
+    sprintf(msgbuf, "%s%s", ENDSTARTUP, CRLF);
+    ret = clientWrite(pos, msgbuf, strlen(msgbuf));
+    sprintf(msgbuf, "%s\n", ENDSTARTUP);
+    logMsg(LEVEL3, msgbuf);
+}
+
+/*
+ * LA: accept() found no descriptor free, so the waiting client would
+ * keep the server socket readable and poll() would not wait.  The spare
+ * descriptor is closed to accept the client and close it, and opened
+ * again.  Without a spare the server socket is taken out of poll()
+ * until dropClient() puts it back.
+ * returns 1 if accept() can be tried again, 0 if not
+ */
+
+int refuseClient()
+{
+    int sd, again, error = errno;
+    char msgbuf[BUFSIZ];
+
+    if (sparefd < 0) sparefd = open("/dev/null", O_RDONLY);
+    if (sparefd >= 0)
+    {
+        close(sparefd);
+        sd = accept(mainsock, NULL, NULL);
+        again = errno;
+        if (sd >= 0) close(sd);
+        sparefd = open("/dev/null", O_RDONLY);
+        if (sd >= 0)
+        {
+            sprintf(msgbuf, "Client refused: %s\n", strerror(error));
+            logMsg(LEVEL1, msgbuf);
+            return 1;
+        }
+        /* none waiting after all, or one that went away */
+        if (again != EMFILE && again != ENFILE)
+            return again == ECONNABORTED || again == EINTR;
+    }
+
+    sprintf(msgbuf, "Clients not accepted until one closes: %s\n",
+            strerror(error));
+    logMsg(LEVEL1, msgbuf);
+    setPoll(mainpos, 0);
+    acceptoff = 1;
+
+    return 0;
+}
+
+/*
+ * LA: the client at pos is closed, forget it; the caller frees the slot
+ */
+
+void dropClient(int pos)
 {
-    int added = 0, pos;
+    dropAsks(pos);
+    if (client[pos].connected) --clients;
+    client[pos].connected = 0;
+    if (acceptoff)
+    {
+        /* its descriptor is closed before the next poll() */
+        acceptoff = 0;
+        setPoll(mainpos, POLLIN | POLLPRI);
+    }
+    outqueued -= client[pos].outlen - client[pos].outhead;
+    free(client[pos].out);
+    client[pos].out = 0;
+    client[pos].outhead = client[pos].outlen = client[pos].outsize = 0;
+}
+
+/*
+ * LA: send len bytes to the client at pos without waiting for it.
+ * What its socket does not take now is queued, behind what is queued
+ * already, and sent by flushClient() on POLLOUT, so a slow client does
+ * not hold up the others.  A write that does not fit in the clientqueue
+ * bytes of the queue goes to slowClient(), unless part of it was sent
+ * and the client is not closed for it: its tail is queued past the
+ * limit then, so the client never gets half a line.
+ * returns the bytes written or queued, or -1 if they were not
+ */
+
+int clientWrite(int pos, char *buf, int len)
+{
+    struct client *cp = &client[pos];
+    int ret = 0;
+    size_t size;
+    char *grown;
+
+    if (!cp->connected) return -1;
+
+    if (cp->outhead == cp->outlen)
+    {
+        if ((ret = write(polld[pos].fd, buf, len)) < 0)
+        {
+            /* a closed client is found by the poll() loop */
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+            ret = 0;
+        }
+        cp->bytesout += ret;
+        if (ret == len) return len;
+    }
+
+    if (cp->outlen - cp->outhead + len - ret > (size_t) clientqueue &&
+        (ret == 0 || slowclient != SLOWDROP))
+        return slowClient(pos, len, ret);
+
+    if (cp->outlen + len - ret > cp->outsize)
+    {
+        /* move what is left to the front, and grow if that is not enough */
+        memmove(cp->out, cp->out + cp->outhead, cp->outlen - cp->outhead);
+        cp->outlen -= cp->outhead;
+        cp->outhead = 0;
+        for (size = cp->outsize ? cp->outsize : BUFSIZ;
+             size < cp->outlen + len - ret; size *= 2);
+        if (size > cp->outsize)
+        {
+            if (!(grown = (char *) realloc(cp->out, size)))
+                return slowClient(pos, len, ret);
+            cp->out = grown;
+            cp->outsize = size;
+        }
+    }
+    memcpy(cp->out + cp->outlen, buf + ret, len - ret);
+    cp->outlen += len - ret;
+    outqueued += len - ret;
+    outtotal += len - ret;
+    setPoll(pos, POLLIN | POLLPRI | POLLOUT);
+
+    return len;
+}
+
+/*
+ * LA: a write does not fit in the queue of the client at pos, it is
+ * closed with --slowclient close, or the write is dropped with drop.
+ * A write with sent bytes already sent is never dropped, the client
+ * is closed instead of getting the start of a line without its end.
+ * returns -1
+ */
+
+int slowClient(int pos, int len, int sent)
+{
+    char msgbuf[BUFSIZ];
+
+    if (slowclient == SLOWDROP && sent == 0)
+    {
+        ++client[pos].drops;
+        ++outdropped;
+        sprintf(msgbuf, "Client %d pos %d is slow, dropped %d bytes, "
+                "%lu bytes queued\n", polld[pos].fd, pos, len,
+                (unsigned long) (client[pos].outlen - client[pos].outhead));
+        logMsg(LEVEL2, msgbuf);
+        return -1;
+    }
+
+    ++outevicted;
+    sprintf(msgbuf, "Removed client %d pos %d, it is slow, "
+            "%lu bytes queued\n", polld[pos].fd, pos,
+            (unsigned long) (client[pos].outlen - client[pos].outhead));
+    logMsg(LEVEL1, msgbuf);
+    dropClient(pos);
+    closePoll(pos);
+
+    return -1;
+}
+
+/*
+ * LA: POLLOUT on the client at pos, send what its socket takes of the
+ * queue, and stop waiting for POLLOUT when it is empty
+ */
+
+void flushClient(int pos)
+{
+    struct client *cp = &client[pos];
+    int ret;
+    char msgbuf[BUFSIZ];
+
+    if (!cp->connected || cp->outhead == cp->outlen)
+    {
+        setPoll(pos, POLLIN | POLLPRI);
+        return;
+    }
+
+    if ((ret = write(polld[pos].fd, cp->out + cp->outhead,
+                     cp->outlen - cp->outhead)) < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+        sprintf(msgbuf, "Removed client %d pos %d, write: %s\n",
+                polld[pos].fd, pos, strerror(errno));
+        logMsg(LEVEL1, msgbuf);
+        dropClient(pos);
+        closePoll(pos);
+        return;
+    }
+    cp->bytesout += ret;
+    cp->outhead += ret;
+    outqueued -= ret;
 
-    for (added = pos = 0; pos < MAXCONNECT; ++pos)
+    if (cp->outhead == cp->outlen)
     {
-        if (polld[pos].fd) continue;
-        ack[pos] = 0;
-        polld[pos].revents = 0;
-        polld[pos].fd = pollfd;
-        polld[pos].events = (POLLIN | POLLPRI);
-        ++added;
-        break;
+        /* the queue is empty, its memory goes until it is needed again */
+        free(cp->out);
+        cp->out = 0;
+        cp->outhead = cp->outlen = cp->outsize = 0;
+        setPoll(pos, POLLIN | POLLPRI);
     }
-    return added ? pos : -1;
 }
 
 void doPoll(int events)
 {
   static int cnt;
-  int num, pos, sd = 0, ret, tmpint;
+  int num, pos, ready, sd = 0, ret, tmpint;
   char buf[BUFSIZ], tmpbuf[BUFSIZ], msgbuf[BUFSIZ], msgbuf2[BUFSIZ];
   char *ptr, *sptr, *eptr, *label;
   char **svrtag;
@@ -1441,18 +1904,28 @@ void doPoll(int events)
   /*
    * Poll is configured for POLLIN and POLLPRI events
    * POLLERR, POLLHUP, POLLNVAL events can also happen
-   * Poll is not configured for the POLLOUT event
+   * LA: POLLOUT only while a client has an output queue
+   * LA: only the slots in pollready[] have events
    */
 
-  for (pos = 0; events && pos < MAXCONNECT; ++pos)
+  for (ready = 0; ready < events; ++ready)
   {
-    if (!polld[pos].revents) continue; /* no events */
+    pos = pollready[ready];
+    if (!polld[pos].revents) continue; /* no events, or closed since */
 
     /* log event flags */
     sprintf(msgbuf, "polld[%d].revents: 0x%X, fd: %d\n",
             pos, polld[pos].revents, polld[pos].fd);
     logMsg(LEVEL9, msgbuf);
 
+    if (hittaSocket(pos))
+    {
+      /* LA: hitta.se lookup socket, all events are for libcurl */
+      hittaEvent(pos, polld[pos].revents);
+      polld[pos].revents = 0;
+      continue;
+    }
+
     if (polld[pos].revents & POLLHUP) /* Hung up */
     {
       if (!noserial && polld[pos].fd == ttyfd)
@@ -1464,8 +1937,8 @@ void doPoll(int events)
       }
       sprintf(msgbuf, "Client %d pos %d Hung Up\n", polld[pos].fd, pos);
       logMsg(LEVEL2, msgbuf);
-      close(polld[pos].fd);
-      polld[pos].fd = polld[pos].events = polld[pos].revents = 0;
+      dropClient(pos);
+      closePoll(pos);
     }
 
     if (polld[pos].revents & POLLERR) /* Poll Error */
@@ -1480,8 +1953,8 @@ void doPoll(int events)
         sprintf(msgbuf, "Poll Error, closed client %d pos %d.\n",
                 polld[pos].fd, pos);
         logMsg(LEVEL1, msgbuf);
-        close(polld[pos].fd);
-        polld[pos].fd = polld[pos].events = polld[pos].revents = 0;
+        dropClient(pos);
+        closePoll(pos);
     }
 
     if (polld[pos].revents & POLLNVAL) /* Invalid Request */
@@ -1496,15 +1969,14 @@ void doPoll(int events)
       sprintf(msgbuf, "Removed client %d pos %d, invalid request.\n",
               polld[pos].fd, pos);
       logMsg(LEVEL1, msgbuf);
-      polld[pos].fd = polld[pos].events = polld[pos].revents = 0;
+      dropClient(pos);
+      delPoll(pos);
     }
 
     if (polld[pos].revents & POLLOUT) /* Write Event */
     {
-      sprintf(msgbuf, "Removed client %d pos %d, write event not configured.\n",
-              polld[pos].fd, pos);
-      logMsg(LEVEL1, msgbuf);
-      polld[pos].fd = polld[pos].events = polld[pos].revents = 0;
+      /* LA: the socket takes more of the client's output queue */
+      flushClient(pos);
     }
 
     if (polld[pos].revents & (POLLIN | POLLPRI))
@@ -1560,84 +2032,24 @@ void doPoll(int events)
       }
       else if (polld[pos].fd == mainsock)
       {
-        /* TCP/IP Client Connection */
-        if ((sd = tcpAccept()) < 0)
+        /* TCP/IP Client Connections, LA: all that are waiting */
+        while (1)
         {
-          sprintf(msgbuf, "Connect Error: %s\n", strerror(errno));
-          logMsg(LEVEL1, msgbuf);
-        }
-        else
-        {
-          /* Client connected */
-
-          if (fcntl(sd, F_SETFL, O_NONBLOCK) < 0)
+          if ((sd = tcpAccept()) >= 0) newClient(sd);
+          else if (errno == ECONNABORTED || errno == EINTR) continue;
+          else if (errno == EMFILE || errno == ENFILE)
           {
-            sprintf(msgbuf, "NONBLOCK Error: %s, sd: %d\n",
-              strerror(errno), sd);
-            logMsg(LEVEL1, msgbuf);
-            close(sd);
+            /* LA: the server socket stays readable until it is taken */
+            if (!refuseClient()) break;
           }
           else
           {
-            if ((pos = addPoll(sd)) < 0)
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
             {
-              sprintf(msgbuf, "Client trying to connect.\n");
-              logMsg(LEVEL1, msgbuf);
-              sprintf(msgbuf, NOLOGSENT NL);
+              sprintf(msgbuf, "Connect Error: %s\n", strerror(errno));
               logMsg(LEVEL1, msgbuf);
-              sprintf(msgbuf, TOOMSG, noserial ? MAXCLIENTS + 1 : MAXCLIENTS,
-                      strdate(WITHSEP), NL);
-              logMsg(LEVEL1, msgbuf);
-              sprintf(buf, NOLOGSENT CRLF);
-              ret = write(sd, buf, strlen(buf));
-              sprintf(buf, TOOMSG, noserial ? MAXCLIENTS + 1 :MAXCLIENTS,
-                      strdate(WITHSEP), CRLF);
-              ret = write(sd, buf, strlen(buf));
-              close(sd);
-            }
-            else
-            {
-              strcpy(IPinfo[pos].addr, tmpIPaddr);
-              strcpy(IPinfo[pos].name, tmpHostName);
-              sprintf(msgbuf, "Client %d pos %d from %s%s connected %s\n", 
-                      sd, pos, IPinfo[pos].addr, IPinfo[pos].name, strdate(WITHSEP));
-              logMsg(LEVEL2, msgbuf);
-
-              sprintf(buf, "%s %s %s%s", ANNOUNCE, name, VERSION, CRLF);
-              ret = write(sd, buf, strlen(buf));
-              sprintf(buf, "%s %s %s\n", ANNOUNCE, name, VERSION);
-              logMsg(LEVEL3, buf);
-
-              sprintf(buf, "%s%s%s", APIANNOUNCE, API, CRLF);
-              ret = write(sd, buf, strlen(buf));
-              sprintf(buf, "%s%s\n", APIANNOUNCE, API);
-              logMsg(LEVEL3, buf);
-
-              if (sendlog)
-              {
-                sendLog(sd, buf);
-              }
-              else
-              {
-                /* CID log not sent */
-                sprintf(msgbuf, "%s%s", NOLOGSENT, CRLF);
-                ret = write(sd, msgbuf, strlen(msgbuf));
-                sprintf(msgbuf, "Call log not sent: %s\n", cidlog);
-                logMsg(LEVEL3, msgbuf);
-              }
-              if (hangup)
-              { 
-                sprintf (msgbuf, OPTLINE "hangup" CRLF);
-                ret = write (sd, msgbuf, strlen(msgbuf));
-                sprintf(msgbuf, "Sent 'hangup' option to client\n");
-                logMsg(LEVEL3, msgbuf);
-              }
-              /* End of startup messages */
-              sprintf(msgbuf, "%s%s", ENDSTARTUP, CRLF);
-              ret = write(sd, msgbuf, strlen(msgbuf));
-              sprintf(msgbuf, "%s\n", ENDSTARTUP);
-              logMsg(LEVEL3, msgbuf);
             }
+            break;
           }
         }
       }
@@ -1654,8 +2066,8 @@ void doPoll(int events)
             {
                 sprintf(msgbuf, "Client %d pos %d removed.\n", polld[pos].fd, pos);
                 logMsg(LEVEL1, msgbuf);
-                close(polld[pos].fd);
-                polld[pos].fd = polld[pos].events = polld[pos].revents = 0;
+                dropClient(pos);
+                closePoll(pos);
             }
           }
           /* read will return 0 for a disconnect */
@@ -1663,10 +2075,10 @@ void doPoll(int events)
           {
             /* TCP/IP Client End Connection */
             sprintf(msgbuf, "Client %d pos %d from %s%s disconnected %s\n",
-                    polld[pos].fd, pos, IPinfo[pos].addr, IPinfo[pos].name, strdate(WITHSEP));
+                    polld[pos].fd, pos, client[pos].addr, client[pos].name, strdate(WITHSEP));
             logMsg(LEVEL2, msgbuf);
-            close(polld[pos].fd);
-            polld[pos].fd = polld[pos].events = polld[pos].revents = 0;
+            dropClient(pos);
+            closePoll(pos);
           }
           else
           {
@@ -1674,6 +2086,10 @@ void doPoll(int events)
              * Client sent message to server
              */
 
+            /* LA: keep track of the client */
+            client[pos].lastread = time(0);
+            client[pos].bytesin += num;
+
             /* Terminate String */
             buf[num] = '\0';
 
@@ -1711,10 +2127,10 @@ void doPoll(int events)
                 logMsg(LEVEL3, msgbuf);
 
                 writeLog(datalog, buf);
-                if (ack[pos])
+                if (client[pos].ack)
                 {
                     sprintf(msgbuf, "%s%s%s", ACKLINE, buf, CRLF);
-                    ret = write(polld[pos].fd, msgbuf, strlen (msgbuf));
+                    ret = clientWrite(pos, msgbuf, strlen (msgbuf));
                     sprintf(msgbuf, "(sd %d) %s%s%s", polld[pos].fd, ACKLINE, buf, NL);
                     logMsg(LEVEL3, msgbuf);
                 }
@@ -1737,10 +2153,10 @@ void doPoll(int events)
                 logMsg(LEVEL3, msgbuf);
 
                 writeLog(datalog, buf);
-                if (ack[pos])
+                if (client[pos].ack)
                 {
                     sprintf(msgbuf, "%s%s%s", ACKLINE, buf, CRLF);
-                    ret = write(polld[pos].fd, msgbuf, strlen (msgbuf));
+                    ret = clientWrite(pos, msgbuf, strlen (msgbuf));
                     sprintf(msgbuf, "(sd %d) %s%s%s", polld[pos].fd, ACKLINE, buf, NL);
                     logMsg(LEVEL3, msgbuf);
                 }
@@ -1946,10 +2362,10 @@ void doPoll(int events)
                 sprintf(msgbuf, "Gateway (sd %d) sent a notice.\n", polld[pos].fd);
                 logMsg(LEVEL3, msgbuf);
                 writeLog(datalog, buf);
-                if (ack[pos])
+                if (client[pos].ack)
                 {
                     sprintf(msgbuf, "%s%s%s", ACKLINE, buf, CRLF);
-                    ret = write(polld[pos].fd, msgbuf, strlen (msgbuf));
+                    ret = clientWrite(pos, msgbuf, strlen (msgbuf));
                     sprintf(msgbuf, "(sd %d) %s%s%s", polld[pos].fd, ACKLINE, buf, NL);
                     logMsg(LEVEL3, msgbuf);
                 }
@@ -1992,12 +2408,12 @@ void doPoll(int events)
                     {
                        strcpy (buf, INFOLINE RELOADED NL);
                     }
-                    ret = write (polld[pos].fd, BEGIN_DATA CRLF,
+                    ret = clientWrite (pos, BEGIN_DATA CRLF,
                                  strlen (BEGIN_DATA CRLF));
                     logMsg(LEVEL2, BEGIN_DATA NL);
-                    ret = write (polld[pos].fd, buf, strlen(buf));
+                    ret = clientWrite (pos, buf, strlen(buf));
                     logMsg(LEVEL2, buf);
-                    ret = write (polld[pos].fd, END_DATA CRLF,
+                    ret = clientWrite (pos, END_DATA CRLF,
                                  strlen (END_DATA CRLF));
                     logMsg(LEVEL2, END_DATA NL);
                  }
@@ -2033,27 +2449,27 @@ void doPoll(int events)
                     if (strstr(msgbuf, NOCHANGES) || strstr(msgbuf, DENIED))
                     {
                         /* There were no changes to the call log */
-                        ret = write (polld[pos].fd, BEGIN_DATA CRLF,
+                        ret = clientWrite (pos, BEGIN_DATA CRLF,
                                      strlen (BEGIN_DATA CRLF));
                         logMsg(LEVEL2, BEGIN_DATA NL);
-                        ret = write (polld[pos].fd, msgbuf, strlen (msgbuf));
+                        ret = clientWrite (pos, msgbuf, strlen (msgbuf));
                         logMsg(LEVEL2, msgbuf);
                     }
                     else
                     {
                         /* There were changes to the call log */
-                        ret = write (polld[pos].fd, BEGIN_DATA1 CRLF,
+                        ret = clientWrite (pos, BEGIN_DATA1 CRLF,
                                      strlen (BEGIN_DATA1 CRLF));
                         logMsg(LEVEL2, BEGIN_DATA1 NL);
-                        ret = write(polld[pos].fd, msgbuf, strlen(msgbuf));
+                        ret = clientWrite(pos, msgbuf, strlen(msgbuf));
                         logMsg(LEVEL2, msgbuf);
                         while (fgets(ptr, cnt, respHandle))
                         {
-                            ret = write(polld[pos].fd, msgbuf, strlen(msgbuf));
+                            ret = clientWrite(pos, msgbuf, strlen(msgbuf));
                             logMsg(LEVEL2, msgbuf);
                         }
                     }
-                    ret = write(polld[pos].fd, END_DATA CRLF,
+                    ret = clientWrite(pos, END_DATA CRLF,
                                 strlen (END_DATA CRLF));
                     pclose (respHandle);
                     logMsg(LEVEL2, END_DATA NL);
@@ -2061,15 +2477,15 @@ void doPoll(int events)
                  }
                  else if (strstr(buf, REREAD))
                  {
-                    sendLog(polld[pos].fd, buf);
+                    sendLog(pos, buf);
                  }
                  else if (!strcmp(buf, REQ_ACK) || !strcmp(buf, REQ_YO))
                  {
-                    if (strstr(buf, ACK)) ack[pos] = 1;
+                    if (strstr(buf, ACK)) client[pos].ack = 1;
                     sprintf(msgbuf, "(sd %d) sent %s\n", polld[pos].fd, buf);
                     logMsg(LEVEL3, msgbuf);
                     sprintf(msgbuf, "%s%s%s", ACKLINE, buf, CRLF);
-                    ret = write(polld[pos].fd, msgbuf, strlen (msgbuf));
+                    ret = clientWrite(pos, msgbuf, strlen (msgbuf));
                     sprintf(msgbuf, "(sd %d) %s%s%s", polld[pos].fd, ACKLINE, buf, NL);
                     logMsg(LEVEL3, msgbuf);
                  }
@@ -2101,6 +2517,19 @@ void doPoll(int events)
                        ptr += strlen(WHT_LST);
                        type = "Whitelist";
                     }
+                    else if (strncmp(ptr, LOOKUP_REQ, strlen(LOOKUP_REQ)) == 0)
+                    {
+                        /* LA: found a REQ: LOOKUP <nmbr> line */
+                        ptr += strlen(LOOKUP_REQ);
+                        while (*ptr == ' ') ++ptr;
+                        if (*ptr)
+                        {
+                            startAsk(pos, ptr);
+                            filename = "Dummy";
+                        }
+                        else filename = "X";
+                        *ptr = 0;
+                    }
                     else if (strncmp(ptr, INFO_REQ, strlen(INFO_REQ)) == 0)
                     {
                        /* found a REQ: INFO <nmbr>&&<name>&&<line> line */
@@ -2138,13 +2567,13 @@ void doPoll(int events)
                                  "End: findALias() [%s]\n", strdate(ONLYTIME));
                         logMsg(LEVEL4, msgbuf);
 
-                        ret = write(polld[pos].fd, BEGIN_DATA3 CRLF,
+                        ret = clientWrite(pos, BEGIN_DATA3 CRLF,
                                      strlen(BEGIN_DATA3 CRLF));
                         logMsg(LEVEL2, BEGIN_DATA3 NL);
                         sprintf(msgbuf, INFOLINE "alias %s\n", temp);
                         logMsg(LEVEL2, msgbuf);
                         sprintf(msgbuf, INFOLINE "alias %s\r\n", temp);
-                        ret = write(polld[pos].fd, msgbuf, strlen(msgbuf));
+                        ret = clientWrite(pos, msgbuf, strlen(msgbuf));
 
                         which = onBlackWhite(name, number);
                         switch (which)
@@ -2169,7 +2598,7 @@ void doPoll(int events)
                                 break;
                         }
                         sprintf (msgbuf, INFOLINE "%s\r\n" END_RESP CRLF, temp);
-                        ret = write (polld[pos].fd, msgbuf, strlen (msgbuf));
+                        ret = clientWrite (pos, msgbuf, strlen (msgbuf));
                         sprintf (msgbuf, INFOLINE "%s\n" END_RESP NL, temp);
                         logMsg(LEVEL2, msgbuf);
 
@@ -2205,7 +2634,7 @@ void doPoll(int events)
 
                         strcat(tmpbuf, "\n");
                         logMsg(LEVEL2, tmpbuf);
-                        ret = write (polld[pos].fd, BEGIN_DATA2 CRLF,
+                        ret = clientWrite (pos, BEGIN_DATA2 CRLF,
                                      strlen (BEGIN_DATA2 CRLF));
                         logMsg(LEVEL2, BEGIN_DATA2 NL);
                         strcpy(msgbuf, RESPLINE);
@@ -2213,10 +2642,10 @@ void doPoll(int events)
                         cnt = sizeof (msgbuf) - sizeof (RESPLINE);
                         while (fgets (ptr, cnt, respHandle))
                         {
-                            ret = write (polld[pos].fd, msgbuf, strlen (msgbuf));
+                            ret = clientWrite (pos, msgbuf, strlen (msgbuf));
                             logMsg(LEVEL2, msgbuf);
                         }
-                        ret = write (polld[pos].fd, END_RESP CRLF,
+                        ret = clientWrite (pos, END_RESP CRLF,
                                      strlen (END_RESP CRLF));
                         pclose (respHandle);
                         logMsg(LEVEL2, END_RESP NL);
@@ -2292,12 +2721,11 @@ void doPoll(int events)
           }
         }
         /* file descripter 0 treated as empty slot */
-        else polld[pos].fd = polld[pos].events = 0;
+        else delPoll(pos);
       }
     }
 
     polld[pos].revents = 0;
-    --events;
   }
 }
 
@@ -2424,7 +2852,7 @@ void getField(char *bufptr, char *field_name, char *mesgptr, char *noval)
 void formatCID(char *buf)
 {
     char cidbuf[BUFSIZ], msgbuf[BUFSIZ], tmpbuf[BUFSIZ];
-    char *ptr, *sptr, *tptr, *linelabel, *nameptr;
+    char *ptr, *sptr, *tptr;
     int i;
     time_t t;
 
@@ -2572,6 +3000,7 @@ void formatCID(char *buf)
 
         /* Make sure the status field and cidsent are zero */
         cid.status = cidsent = 0;
+        dropLookup();
 
         if ((ptr = strstr(buf, "DATE")))
         {
@@ -2652,12 +3081,7 @@ void formatCID(char *buf)
                 ptr = strchr(cidbuf, '.');
                 if (ptr) *ptr = 0;
                 /* LA: Start mod: Find Name using hitta.se & tidy Nmbr */
-                sprintf(msgbuf, "Begin: hittaAlias() [%s]\n", strdate(ONLYTIME));
-                logMsg(LEVEL4, msgbuf);
-                hittaAlias(cid.cidname, cidbuf);
-                sprintf(msgbuf, "End: hittaAlias() [%s]\n", strdate(ONLYTIME));
-                logMsg(LEVEL4, msgbuf);
-                cid.status |= CIDNAME;
+                startLookup(cidbuf);
                 /* LA: Stopp mod: Find Name using hitta.se */
                 builtinAlias(cid.cidnmbr, cidbuf);
            }
@@ -2693,6 +3117,7 @@ void formatCID(char *buf)
 
         /* Make sure the status field and cidsent are zero */
         cid.status = cidsent = 0;
+        dropLookup();
 
         /* copy data to working buffer and init pointer */
         strncpy(cidbuf, buf, BUFSIZ - 1);
@@ -2839,12 +3264,7 @@ void formatCID(char *buf)
             else while (*ptr && !isblank((int) *ptr)) ++ptr; /* this should never happen */
             if (*ptr == ' ') ++ptr;
             /* LA: Start mod: Find Name using hitta.se & tidy Nmbr */
-            sprintf(msgbuf, "Begin: hittaAlias() [%s]\n", strdate(ONLYTIME));
-            logMsg(LEVEL4, msgbuf);
-            hittaAlias(cid.cidname, ptr);
-            sprintf(msgbuf, "End: hittaAlias() [%s]\n", strdate(ONLYTIME));
-            logMsg(LEVEL4, msgbuf);
-            cid.status |= CIDNAME;
+            startLookup(ptr);
             /* LA: Stopp mod: Find Name using hitta.se */
             builtinAlias(cid.cidnmbr, ptr);
             cid.status |= CIDNMBR;
@@ -2938,79 +3358,24 @@ void formatCID(char *buf)
            "date, time, nmbr, name" : "date, time, nmbr, name, mesg");
        logMsg(LEVEL4, msgbuf);
 
-        userAlias(cid.cidnmbr, cid.cidname, cid.cidline);
-
-        switch(calltype)
+        if (!parked) sendCID(&cid, calltype, (char *) 0);
+        else if (parked->done)
         {
-            case CID:
-                linelabel = CIDLINE;
-                break;
-            case OUT:
-                linelabel = OUTLINE;
-                break;
-            case HUP:
-                linelabel = HUPLINE;
-                break;
-            case BLK:
-                linelabel = BLKLINE;
-                break;
-            case PID:
-                linelabel = PIDLINE;
-                break;
-            case WID:
-                linelabel = WIDLINE;
-                break;
-            default: /* should not happen */
-                linelabel = CIDLINE;
-                break;
+            /* hitta.se already answered */
+            strcpy(cid.cidname, parked->cid.cidname);
+            free(parked);
+            parked = 0;
+            sendCID(&cid, calltype, (char *) 0);
         }
-        nameptr = cid.cidname;
-        if (hangup && linelabel == &CIDLINE[0])
+        else
         {
-            /*
-             * hangup phone
-             * if a CID call and if on blacklist but not whitelist
-             */
-            if (doHangup(cid.cidname, cid.cidnmbr))
-            {
-                linelabel = HUPLINE;
-                if (strlen(listname)) nameptr = listname;
-            }
-            else if (wflag && strlen(listname)) nameptr = listname;
+            /* LA: park the call until hitta.se answers, see lookupDone() */
+            parked->cid = cid;
+            parked->calltype = calltype;
+            waitLookup(parked);
+            parked = 0;
         }
 
-        sprintf(cidbuf, "%s%s%s%s%s%s%s%s%s%s%s%s%s%s",
-            linelabel,
-            DATE, cid.ciddate,
-            TIME, cid.cidtime,
-            LINE, cid.cidline,
-            NMBR, cid.cidnmbr,
-            MESG, cid.cidmesg,
-            NAME, nameptr,
-            STAR);
-
-        /* Log the CID, OUT, or HUP text line */
-        writeLog(cidlog, cidbuf);
-
-        /*
-         * Send the CID, OUT, or HUP text line to clients
-         */
-        writeClients(cidbuf);
-
-        /*
-         * LA: Inserted send to ZIR 
-         */
-        sprintf(cidbuf, "MSG: Samtal till %s från %s - %s & CIDLOW: %s %s\r\n",
-            cid.cidline,
-            cid.cidnmbr,
-            cid.cidname, 
-            cid.cidnmbr,
-            cid.cidname);
-        sendMsg(cidbuf);
-        /* 
-         * LA: End Inserted send to ZIR 
-         */ 
-        
         /*
          * Reset mesg, line, and status
          * Set sent indicator
@@ -3025,6 +3390,429 @@ void formatCID(char *buf)
     }
 }
 
+/*
+ * Create the CID (Caller ID), OUT (outgoing call), HUP (hungup call),
+ * or BLK (call blocked) text line, log it, and send it to the clients.
+ */
+
+void sendCID(struct cid *cidptr, int type, char *logline)
+{
+    char cidbuf[BUFSIZ], *linelabel, *nameptr;
+
+    userAlias(cidptr->cidnmbr, cidptr->cidname, cidptr->cidline);
+
+    switch(type)
+    {
+        case CID:
+            linelabel = CIDLINE;
+            break;
+        case OUT:
+            linelabel = OUTLINE;
+            break;
+        case HUP:
+            linelabel = HUPLINE;
+            break;
+        case BLK:
+            linelabel = BLKLINE;
+            break;
+        case PID:
+            linelabel = PIDLINE;
+            break;
+        case WID:
+            linelabel = WIDLINE;
+            break;
+        default: /* should not happen */
+            linelabel = CIDLINE;
+            break;
+    }
+    nameptr = cidptr->cidname;
+    if (hangup && linelabel == &CIDLINE[0])
+    {
+        /*
+         * hangup phone
+         * if a CID call and if on blacklist but not whitelist
+         */
+        if (doHangup(cidptr->cidname, cidptr->cidnmbr))
+        {
+            linelabel = HUPLINE;
+            if (strlen(listname)) nameptr = listname;
+        }
+        else if (wflag && strlen(listname)) nameptr = listname;
+    }
+
+    sprintf(cidbuf, "%s%s%s%s%s%s%s%s%s%s%s%s%s%s",
+        linelabel,
+        DATE, cidptr->ciddate,
+        TIME, cidptr->cidtime,
+        LINE, cidptr->cidline,
+        NMBR, cidptr->cidnmbr,
+        MESG, cidptr->cidmesg,
+        NAME, nameptr,
+        STAR);
+
+    /* Log the CID, OUT, or HUP text line */
+    writeLog(cidlog, cidbuf);
+
+    /* LA: keep the logged line for a late hitta.se name */
+    if (logline) strcpy(logline, cidbuf);
+
+    /*
+     * Send the CID, OUT, or HUP text line to clients
+     */
+    writeClients(cidbuf);
+
+    /*
+     * LA: Inserted send to ZIR 
+     */
+    sprintf(cidbuf, "MSG: Samtal till %s från %s - %s & CIDLOW: %s %s\r\n",
+        cidptr->cidline,
+        cidptr->cidnmbr,
+        cidptr->cidname, 
+        cidptr->cidnmbr,
+        cidptr->cidname);
+    sendMsg(cidbuf);
+}
+
+/*
+ * LA: Find Name using hitta.se & tidy Nmbr
+ *
+ * The number is tidied right away.  If hitta.se must be asked, the
+ * name comes later to lookupDone() and the call may have to wait in
+ * a parked call record for it.
+ */
+
+void startLookup(char *nmbr)
+{
+    char msgbuf[BUFSIZ];
+
+    dropLookup();
+    if (!(parked = (struct park *) calloc(1, sizeof(struct park))))
+        errorExit(-1, name, 0);
+
+    sprintf(msgbuf, "Begin: hittaAlias() [%s]\n", strdate(ONLYTIME));
+    logMsg(LEVEL4, msgbuf);
+    parked->deadline = hittaNow() + hittawait;
+
+    /* not the name of the last call, if hitta.se has none */
+    strncpy(cid.cidname, NONAME, CIDSIZE - 1);
+    if (!hittaAlias(cid.cidname, nmbr, HITTA_LIVE, lookupDone, parked))
+    {
+        /* name found without a lookup, or none found */
+        free(parked);
+        parked = 0;
+        sprintf(msgbuf, "End: hittaAlias() [%s]\n", strdate(ONLYTIME));
+        logMsg(LEVEL4, msgbuf);
+
+        /* without a name the NAME from the modem or gateway is taken */
+        if (!strcmp(cid.cidname, NONAME)) return;
+    }
+    cid.status |= CIDNAME;
+}
+
+/*
+ * LA: a client asked for the name of a number with REQ: LOOKUP
+ *
+ * The name comes from hittaAlias() as for a call, so the phonebook and
+ * the cache answer at once and a number already being looked up is not
+ * asked for again.  Otherwise askDone() answers the client from the
+ * poll() loop.  The lookup is HITTA_BACKGROUND, so the rate limit keeps
+ * its reserve for calls; if it refuses, the client gets no name.
+ */
+
+void startAsk(int pos, char *nmbr)
+{
+    struct ask *ask;
+    char msgbuf[BUFSIZ];
+
+    if (!(ask = (struct ask *) calloc(1, sizeof(struct ask))))
+        errorExit(-1, name, 0);
+    ask->pos = pos;
+    ask->fd = polld[pos].fd;
+    strncpy(ask->nmbr, nmbr, CIDSIZE - 1);
+
+    sprintf(msgbuf, "Client %d pos %d sent %s %s\n", polld[pos].fd, pos,
+            LOOKUP_REQ, ask->nmbr);
+    logMsg(LEVEL3, msgbuf);
+
+    if (!hittaAlias(ask->name, ask->nmbr, HITTA_BACKGROUND, askDone, ask))
+    {
+        /* name known, or no lookup could be started */
+        sendAsk(ask);
+        free(ask);
+        return;
+    }
+    ask->next = asked;
+    asked = ask;
+}
+
+/*
+ * LA: hitta.se lookup for a client finished, answer it if it is still there
+ */
+
+void askDone(char *hittaname, void *arg)
+{
+    struct ask *ask = (struct ask *) arg, **ap;
+
+    for (ap = &asked; *ap && *ap != ask; ap = &(*ap)->next);
+    if (*ap) *ap = ask->next;
+
+    strncpy(ask->name, hittaname, CIDSIZE - 1);
+    if (ask->fd) sendAsk(ask);
+    free(ask);
+}
+
+/*
+ * LA: the name for a REQ: LOOKUP, empty if none was found
+ *
+ * BEGIN_DATA3
+ * INFO: nmbr <nmbr>
+ * INFO: name <name>
+ * END_RESP
+ */
+
+void sendAsk(struct ask *ask)
+{
+    int ret;
+    char msgbuf[BUFSIZ];
+
+    ret = clientWrite(ask->pos, BEGIN_DATA3 CRLF, strlen(BEGIN_DATA3 CRLF));
+    logMsg(LEVEL2, BEGIN_DATA3 NL);
+    sprintf(msgbuf, INFOLINE "nmbr %s\r\n" INFOLINE "name %s\r\n" END_RESP CRLF,
+            ask->nmbr, ask->name);
+    ret = clientWrite(ask->pos, msgbuf, strlen(msgbuf));
+    sprintf(msgbuf, INFOLINE "nmbr %s\n" INFOLINE "name %s\n" END_RESP NL,
+            ask->nmbr, ask->name);
+    logMsg(LEVEL2, msgbuf);
+    (void) ret;
+}
+
+/*
+ * LA: the client at pos went away, its lookups finish for the cache only
+ */
+
+void dropAsks(int pos)
+{
+    struct ask *ask;
+
+    for (ask = asked; ask; ask = ask->next)
+        if (ask->pos == pos && ask->fd == polld[pos].fd) ask->fd = 0;
+}
+
+/*
+ * LA: read the name after the '=' of each alias line in ncidd.alias,
+ * quoted or up to a blank, into targets
+ */
+
+void readTargets()
+{
+    FILE *fp;
+    struct target *tp;
+    char line[BUFSIZ], *ptr, *end;
+    int quoted;
+
+    if (!(fp = fopen(cidalias, "r"))) return;
+    while (fgets(line, sizeof(line), fp))
+    {
+        for (ptr = line; *ptr == ' ' || *ptr == '\t'; ++ptr);
+        if (strncmp(ptr, "alias", 5)) continue;
+
+        /* the '=' that is not in the quoted name before it */
+        for (quoted = 0; *ptr && (quoted || *ptr != '='); ++ptr)
+            if (*ptr == '"') quoted = !quoted;
+        if (!*ptr) continue;
+        for (++ptr; *ptr == ' ' || *ptr == '\t'; ++ptr);
+        if (*ptr == '"')
+        {
+            if (!(end = strchr(++ptr, '"'))) continue;
+        }
+        else end = ptr + strcspn(ptr, " \t\r\n");
+        if (end == ptr || end - ptr >= CIDSIZE) continue;
+
+        if (!(tp = (struct target *) calloc(1, sizeof(struct target))))
+            break;
+        strncpy(tp->name, ptr, end - ptr);
+        tp->next = targets;
+        targets = tp;
+    }
+    fclose(fp);
+}
+
+/*
+ * LA: a name in cidcall.log is a hitta.se name unless an alias gave
+ * it, or sendCID() logged the blacklist or whitelist entry the call
+ * matched, which it only does with hangup
+ * returns 1 for a hitta.se name, 0 if not
+ */
+
+int warmName(char *nmbr, char *name)
+{
+    static int loaded;
+    struct target *tp;
+
+    if (hangup && onBlackWhite(name, nmbr)) return 0;
+
+    if (!loaded)
+    {
+        readTargets();
+        loaded = 1;
+    }
+    for (tp = targets; tp; tp = tp->next)
+        if (!strcmp(tp->name, name)) return 0;
+
+    return 1;
+}
+
+/*
+ * LA: the call being received was never completed, so the name of
+ * its hitta.se lookup is not wanted
+ */
+
+void dropLookup()
+{
+    if (parked)
+    {
+        if (parked->done) free(parked);
+        else parked->ready = -1;
+        parked = 0;
+    }
+}
+
+/*
+ * LA: a complete call waits for its hitta.se name, for at most
+ * hittawait ms from when the lookup started
+ */
+
+void waitLookup(struct park *park)
+{
+    struct park **pp;
+
+    if (hittawait && hittaNow() >= park->deadline)
+    {
+        /* no time left, send the call now and update it later */
+        sendCID(&park->cid, park->calltype, park->line);
+        park->ready = 2;
+        logMsg(LEVEL4, "sent call without hitta.se name\n");
+        return;
+    }
+
+    park->ready = 1;
+    park->next = 0;
+    for (pp = &waiting; *pp; pp = &(*pp)->next);
+    *pp = park;
+    logMsg(LEVEL4, "waiting for hitta.se name\n");
+}
+
+/*
+ * LA: poll() timeout, shortened if a waiting call must be sent before it
+ */
+
+int parkTimeout(int timeout)
+{
+    long left;
+
+    if (!waiting || !hittawait) return timeout;
+    left = waiting->deadline - hittaNow();
+    if (left < 0) left = 0;
+
+    return left < timeout ? (int) left : timeout;
+}
+
+/*
+ * LA: send the waiting calls whose time is up, with the name they have
+ */
+
+void parkTimer()
+{
+    struct park *park;
+
+    while (hittawait && (park = waiting) && hittaNow() >= park->deadline)
+    {
+        waiting = park->next;
+        sendCID(&park->cid, park->calltype, park->line);
+        park->ready = 2;
+        logMsg(LEVEL4, "sent call without hitta.se name\n");
+    }
+}
+
+/*
+ * LA: hitta.se lookup finished, send the call if it was waiting,
+ * or an update if it was sent without the name
+ */
+
+void lookupDone(char *hittaname, void *arg)
+{
+    struct park *park = (struct park *) arg, **pp;
+    char msgbuf[BUFSIZ];
+
+    sprintf(msgbuf, "End: hittaAlias() [%s]\n", strdate(ONLYTIME));
+    logMsg(LEVEL4, msgbuf);
+
+    if (park->ready < 0)
+    {
+        /* call was dropped */
+        free(park);
+        return;
+    }
+
+    if (park->ready == 2)
+    {
+        sendUpdate(park, hittaname);
+        free(park);
+        return;
+    }
+
+    strncpy(park->cid.cidname, hittaname, CIDSIZE - 1);
+    if (park->ready)
+    {
+        for (pp = &waiting; *pp != park; pp = &(*pp)->next);
+        *pp = park->next;
+        sendCID(&park->cid, park->calltype, (char *) 0);
+        free(park);
+    }
+    else park->done = 1;
+}
+
+/*
+ * LA: a hitta.se name came after its call line was sent
+ *
+ * The NAME of the call line is replaced in cidcall.log, and the
+ * clients get the call line again with an UPD label:
+ *
+ * UPD: *DATE*<date>*TIME*<time>*LINE*<line>*NMBR*<nmbr>*MESG*<mesg>*NAME*<name>*
+ */
+
+void sendUpdate(struct park *park, char *hittaname)
+{
+    char cidbuf[BUFSIZ], updbuf[BUFSIZ], *ptr;
+
+    strncpy(park->cid.cidname, hittaname, CIDSIZE - 1);
+    userAlias(park->cid.cidnmbr, park->cid.cidname, park->cid.cidline);
+
+    /* the logged line, with the new name */
+    if (!(ptr = strstr(park->line, NAME))) return;
+    ptr += strlen(NAME);
+    sprintf(cidbuf, "%.*s%s%s", (int) (ptr - park->line), park->line,
+        park->cid.cidname, STAR);
+    if (!strcmp(cidbuf, park->line)) return;
+
+    patchLog(cidlog, park->line, cidbuf);
+
+    if ((ptr = strchr(cidbuf, '*')))
+    {
+        sprintf(updbuf, "%s%s", UPDLINE, ptr);
+        writeClients(updbuf);
+    }
+
+    /* LA: the name to ZIR */
+    sprintf(updbuf, "MSG: Samtal till %s från %s - %s & CIDLOW: %s %s\r\n",
+        park->cid.cidline,
+        park->cid.cidnmbr,
+        park->cid.cidname, 
+        park->cid.cidnmbr,
+        park->cid.cidname);
+    sendMsg(updbuf);
+}
+
 /*
  * remove whitespace from the start and end of a string
  */
@@ -3042,18 +3830,15 @@ return sptr;
 
 void writeClients(char *inbuf)
 {
-    int pos, ret;
+    int i, pos;
     char buf[BUFSIZ];
 
-    (void) ret;
-
     strcat(strcpy(buf, inbuf), CRLF);
-    for (pos = 0; pos < MAXCONNECT; ++pos)
+    /* LA: backwards, a slow client closed moves the last slot to i */
+    for (i = pollused - 1; i >= 0; --i)
     {
-        if (polld[pos].fd == 0 || polld[pos].fd == ttyfd ||
-            polld[pos].fd == mainsock)
-            continue;
-        ret = write(polld[pos].fd, buf, strlen(buf));
+        pos = pollslot[i];
+        if (client[pos].connected) clientWrite(pos, buf, strlen(buf));
     }
 }
 
@@ -3061,25 +3846,27 @@ void writeClients(char *inbuf)
  * Send log, if log file exists.
  */
 
-void sendLog(int sd, char *logbuf)
+void sendLog(int pos, char *logbuf)
 {
     struct stat statbuf;
     char **ptr, *iptr, *optr, input[BUFSIZ], msgbuf[BUFSIZ];
     FILE *fp;
     int ret, len;
 
+    (void) ret;
+
     if (stat(cidlog, &statbuf) == 0)
     {
         if ((long unsigned int) statbuf.st_size > cidlogmax)
         {
             sprintf(logbuf, LOGMSG, (long unsigned int) statbuf.st_size,
                     cidlogmax, strdate(WITHSEP), CRLF);
-            ret = write(sd, logbuf, strlen(logbuf));
+            ret = clientWrite(pos, logbuf, strlen(logbuf));
             sprintf(msgbuf, LOGMSG, (long unsigned int) statbuf.st_size,
                     cidlogmax, strdate(WITHSEP), NL);
             logMsg(LEVEL1, msgbuf);
             sprintf(msgbuf, "%s%s", NOLOGSENT, CRLF);
-            ret = write(sd, msgbuf, strlen(msgbuf));
+            ret = clientWrite(pos, msgbuf, strlen(msgbuf));
             return;
         }
     }
@@ -3087,7 +3874,7 @@ void sendLog(int sd, char *logbuf)
     if ((fp = fopen(cidlog, "r")) == NULL)
     {
         sprintf(msgbuf, "%s%s", NOLOG, CRLF);
-        ret = write(sd, msgbuf, strlen(msgbuf));
+        ret = clientWrite(pos, msgbuf, strlen(msgbuf));
         sprintf(msgbuf, "cidlog: %d %s [%s]\n", errno, strerror(errno), strdate(ONLYTIME));
         logMsg(LEVEL6, msgbuf);
         return;
@@ -3130,31 +3917,17 @@ void sendLog(int sd, char *logbuf)
          */
         strcat(strncat(strcpy(optr, LOGLINE), iptr, BUFSIZ - (iptr - input - 1)), CRLF);
         len = strlen(logbuf);
-        ret = write(sd, logbuf, len);
-
-        optr = logbuf;
-        while ((ret != -1 && ret != len) ||
-               (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)))
-        {
-            /* short write or resource busy, need to attempt subsequent write */
-
-            if (ret != -1 && ret != len)
-            {
-               /* short write, */
-               len -= ret;
-               optr += ret;
-            }
 
-            /* short delay before trying to rewrite line or rest of line */
-            usleep(READWAIT);
-            ret = write(sd, optr, len);
-        }
-
-        if (ret == -1)
+        /*
+         * LA: what the socket does not take is queued for POLLOUT,
+         * stop if the client was too slow for its queue
+         */
+        if (clientWrite(pos, logbuf, len) < 0)
         {
-            /* write error */
-            sprintf(msgbuf, "sending log: %d %s\n", errno, strerror(errno));
+            sprintf(msgbuf, "sending log: client %d pos %d is slow\n",
+                    polld[pos].fd, pos);
             logMsg(LEVEL1, msgbuf);
+            break;
         }
     }
 
@@ -3165,14 +3938,14 @@ void sendLog(int sd, char *logbuf)
     {
         /* Indicate end of the Call Log */
         sprintf(msgbuf, "%s%s", LOGEND, CRLF);
-        ret = write(sd, msgbuf, strlen(msgbuf));
+        ret = clientWrite(pos, msgbuf, strlen(msgbuf));
         sprintf(msgbuf, "Sent call log: %s\n", cidlog);
         logMsg(LEVEL3, msgbuf);
     }
     else
     {
         sprintf(msgbuf, "%s%s", EMPTYLOG, CRLF);
-        ret = write(sd, msgbuf, strlen(msgbuf));
+        ret = clientWrite(pos, msgbuf, strlen(msgbuf));
         sprintf(msgbuf, "Call log empty: %s\n", cidlog);
         logMsg(LEVEL3, msgbuf);
     }
@@ -3209,6 +3982,72 @@ void writeLog(char *logf, char *logbuf)
     }
 }
 
+/*
+ * LA: replace a line near the end of a log file, the lines after
+ * it are moved if the length changed
+ */
+
+void patchLog(char *logf, char *oldline, char *newline)
+{
+    int logfd, len, ret;
+    off_t size, start;
+    char *buf, *ptr, *first, *found = 0, msgbuf[BUFSIZ];
+    struct stat statbuf;
+
+    (void) ret;
+
+    if ((logfd = open(logf, O_RDWR)) < 0)
+    {
+        sprintf(msgbuf, "%s: %s\n", logf, strerror(errno));
+        logMsg(LEVEL6, msgbuf);
+        return;
+    }
+    if (fstat(logfd, &statbuf) < 0 ||
+        !(buf = malloc(PATCHTAIL + strlen(newline) + 2)))
+    {
+        close(logfd);
+        return;
+    }
+
+    size = statbuf.st_size;
+    start = size > PATCHTAIL ? size - PATCHTAIL : 0;
+    if (pread(logfd, buf, size - start, start) != size - start)
+    {
+        free(buf);
+        close(logfd);
+        return;
+    }
+    buf[size - start] = 0;
+
+    /* the last line that is the old line, the first may be cut */
+    len = strlen(oldline);
+    first = buf;
+    if (start && (ptr = strchr(buf, '\n'))) first = ptr + 1;
+    for (ptr = first; (ptr = strstr(ptr, oldline)); ptr += len)
+        if ((ptr == first || ptr[-1] == '\n') && ptr[len] == '\n') found = ptr;
+
+    if (!found)
+    {
+        sprintf(msgbuf, "Call line not found in %s for update\n", logf);
+        logMsg(LEVEL3, msgbuf);
+    }
+    else
+    {
+        /* new line and the lines after the old one */
+        ptr = found + len + 1;
+        memmove(found + strlen(newline) + 1, ptr, strlen(ptr) + 1);
+        memcpy(found, newline, strlen(newline));
+        found[strlen(newline)] = '\n';
+        ret = pwrite(logfd, found, strlen(found), start + (found - buf));
+        ret = ftruncate(logfd, start + strlen(buf));
+
+        sprintf(msgbuf, "Updated %s: %s\n", logf, newline);
+        logMsg(LEVEL3, msgbuf);
+    }
+    free(buf);
+    close(logfd);
+}
+
 /*
  * LA: Send MSG & APN message to ZIR.
  */
@@ -3415,7 +4254,6 @@ return ret;
 
 void cleanup()
 {
-    int pos;
     char msgbuf[BUFSIZ];
 
     /* restore tty parameters */
@@ -3425,9 +4263,12 @@ void cleanup()
         tcsetattr(ttyfd, TCSANOW, &otty);
     }
 
+    /* LA: stop hitta.se lookups, curl closes its own sockets and
+       hittaCleanup() takes them out of polld[] first */
+    hittaCleanup();
+
     /* close open files */
-    for (pos = 0; pos < MAXCONNECT; ++pos)
-        if (polld[pos].fd != 0) close(polld[pos].fd);
+    while (pollused) closePoll(pollslot[0]);
 
     /* remove pid file, if it was created */
     if (pid)
@@ -3533,23 +4374,42 @@ void update_cidcall_log (int sig)
 /* signal show connected clients */
 void showConnected(int sig)
 {
-    int pos;
+    int i, pos;
     char msgbuf[BUFSIZ];
 
     sprintf(msgbuf, "Received Signal %d: %s at %s\n",
             sig, strsignal(sig), strdate(WITHSEP));
     logMsg(LEVEL1, msgbuf);
 
-    for (pos = 0; pos < MAXCONNECT; ++pos)
+    for (i = 0; i < pollused; ++i)
     {
-        if (polld[pos].fd == 0 || polld[pos].fd == ttyfd ||
-            polld[pos].fd == mainsock)
-            continue;
+        pos = pollslot[i];
+        if (!client[pos].connected) continue;
             
         sprintf(msgbuf, "Client %5d pos %5d from %s%s is connected\n", 
-            polld[pos].fd, pos, IPinfo[pos].addr, IPinfo[pos].name);
+            polld[pos].fd, pos, client[pos].addr, client[pos].name);
+        logMsg(LEVEL1, msgbuf);
+        sprintf(msgbuf, "  for %ld s, last read %ld s ago, "
+            "%lu bytes read, %lu bytes written\n",
+            (long) (time(0) - client[pos].connected),
+            (long) (time(0) - client[pos].lastread),
+            client[pos].bytesin, client[pos].bytesout);
+        logMsg(LEVEL1, msgbuf);
+        sprintf(msgbuf, "  %lu bytes queued, %lu writes dropped\n",
+            (unsigned long) (client[pos].outlen - client[pos].outhead),
+            client[pos].drops);
         logMsg(LEVEL1, msgbuf);
     }
+    sprintf(msgbuf, "%d of at most %d clients, %d of %d poll slots used\n",
+        clients, maxclients, pollused, pollsize);
+    logMsg(LEVEL1, msgbuf);
+    sprintf(msgbuf, "output queues: %lu bytes queued, %lu bytes in all, "
+        "%lu writes dropped, %lu slow clients removed\n",
+        outqueued, outtotal, outdropped, outevicted);
+    logMsg(LEVEL1, msgbuf);
+
+    /* LA: how long the hitta.se lookups take */
+    hittaStats();
 }
     
 
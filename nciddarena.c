@@ -0,0 +1,229 @@
+/*
+ * nciddarena.c - This file is part of ncidd.
+ *
+ * LA: memory arena for the libxml2 allocations of a hitta.se request
+ *
+ * The tree, the parser and the XPath results of a page are many small
+ * blocks, freed one by one when the request ends; over weeks that
+ * leaves the heap of a small board in pieces.  arenaInstall() gives
+ * libxml2 allocation functions that take the blocks from the arena in
+ * use, in ARENACHUNK chunks, and arenaRelease() gives back all of its
+ * chunks at once when the request ends.  A free() in an arena only
+ * counts the block, outside an arena the heap is used as before.
+ *
+ * Each block has a header with its arena and size, so a block is freed
+ * right wherever it is freed from.  If libxml2 keeps a block of an
+ * arena after its request ended, the arena is kept until that block
+ * is freed too.
+ *
+ * ncidd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ncidd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ncidd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ncidd.h"
+#include "nciddarena.h"
+#include <libxml/xmlmemory.h>
+
+/* before each block, 16 bytes so the block is aligned for any type */
+union header
+{
+    struct
+    {
+        struct arena *arena;        /* 0 if from the heap */
+        size_t size;
+    } h;
+    long double align;
+};
+
+struct chunk
+{
+    struct chunk *next;
+    size_t size, used;              /* bytes after the chunk header */
+};
+
+#define CHUNKHEAD   ((sizeof(struct chunk) + 15) & ~(size_t) 15)
+
+struct arena
+{
+    struct chunk *chunks;           /* the first is the one in use */
+    long live;                      /* blocks not freed */
+    int released;                   /* the request ended */
+};
+
+unsigned long arenachunks, arenaorphans;
+
+static struct arena *current;
+
+/* the functions libxml2 had before, used for the heap and the chunks */
+static xmlFreeFunc heapFree;
+static xmlMallocFunc heapMalloc;
+static xmlReallocFunc heapRealloc;
+static xmlStrdupFunc heapStrdup;
+
+static void arenaDestroy(struct arena *ap)
+{
+    struct chunk *cp;
+
+    while ((cp = ap->chunks))
+    {
+        ap->chunks = cp->next;
+        heapFree(cp);
+        --arenachunks;
+    }
+    heapFree(ap);
+}
+
+static void *arenaAlloc(struct arena *ap, size_t size)
+{
+    struct chunk *cp = ap->chunks;
+    union header *hp;
+    size_t need = sizeof(union header) + ((size + 15) & ~(size_t) 15);
+
+    if (!cp || cp->size - cp->used < need)
+    {
+        /* a big block gets a chunk of its own, behind the one in use */
+        if (!(cp = heapMalloc(CHUNKHEAD + (need > ARENACHUNK ? need : ARENACHUNK))))
+            return 0;
+        cp->size = need > ARENACHUNK ? need : ARENACHUNK;
+        cp->used = 0;
+        if (need > ARENACHUNK && ap->chunks)
+        {
+            cp->next = ap->chunks->next;
+            ap->chunks->next = cp;
+        }
+        else
+        {
+            cp->next = ap->chunks;
+            ap->chunks = cp;
+        }
+        ++arenachunks;
+    }
+
+    hp = (union header *) ((char *) cp + CHUNKHEAD + cp->used);
+    cp->used += need;
+    hp->h.arena = ap;
+    hp->h.size = size;
+    ++ap->live;
+
+    return hp + 1;
+}
+
+static void *arenaMalloc(size_t size)
+{
+    union header *hp;
+
+    if (current) return arenaAlloc(current, size);
+
+    if (!(hp = heapMalloc(sizeof(union header) + size))) return 0;
+    hp->h.arena = 0;
+    hp->h.size = size;
+    return hp + 1;
+}
+
+static void arenaFree(void *ptr)
+{
+    union header *hp = (union header *) ptr - 1;
+    struct arena *ap;
+
+    if (!ptr) return;
+    if (!(ap = hp->h.arena)) heapFree(hp);
+    else if (!--ap->live && ap->released)
+    {
+        /* the last block kept after its request */
+        arenaDestroy(ap);
+        --arenaorphans;
+    }
+}
+
+static void *arenaRealloc(void *ptr, size_t size)
+{
+    union header *hp = (union header *) ptr - 1;
+    struct arena *saved;
+    void *np;
+
+    if (!ptr) return arenaMalloc(size);
+
+    if (!hp->h.arena)
+    {
+        if (!(hp = heapRealloc(hp, sizeof(union header) + size))) return 0;
+        hp->h.size = size;
+        return hp + 1;
+    }
+    if (size <= hp->h.size) return ptr;
+
+    /* a new block in the same arena */
+    saved = current;
+    current = hp->h.arena;
+    np = arenaMalloc(size);
+    current = saved;
+    if (!np) return 0;
+    memcpy(np, ptr, hp->h.size);
+    arenaFree(ptr);
+
+    return np;
+}
+
+static char *arenaStrdup(const char *str)
+{
+    size_t len = strlen(str) + 1;
+    char *ptr;
+
+    if ((ptr = arenaMalloc(len))) memcpy(ptr, str, len);
+    return ptr;
+}
+
+/*
+ * Give libxml2 the arena functions, before it allocates anything
+ * returns 0, or -1 if libxml2 did not take them
+ */
+int arenaInstall()
+{
+    if (xmlMemGet(&heapFree, &heapMalloc, &heapRealloc, &heapStrdup) < 0)
+        return -1;
+    if (xmlGcMemSetup(arenaFree, arenaMalloc, arenaMalloc, arenaRealloc,
+        arenaStrdup) < 0) return -1;
+
+    return 0;
+}
+
+/* a new arena, 0 if there is no memory */
+struct arena *arenaNew()
+{
+    struct arena *ap;
+
+    if ((ap = heapMalloc(sizeof(struct arena))))
+        memset(ap, 0, sizeof(struct arena));
+    return ap;
+}
+
+/* libxml2 allocates from arena, or the heap if 0, returns the one before */
+struct arena *arenaUse(struct arena *arena)
+{
+    struct arena *before = current;
+
+    current = arena;
+    return before;
+}
+
+/* the request of an arena ended, its chunks go back all at once */
+void arenaRelease(struct arena *arena)
+{
+    if (!arena) return;
+    if (current == arena) current = 0;
+    if (!arena->live) arenaDestroy(arena);
+    else
+    {
+        arena->released = 1;
+        ++arenaorphans;
+    }
+}
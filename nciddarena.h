@@ -0,0 +1,29 @@
+/*
+ * nciddarena.h - This file is part of ncidd.
+ *
+ * LA: memory arena for the libxml2 allocations of a hitta.se request
+ *
+ * ncidd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ncidd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ncidd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define ARENACHUNK      32768       /* bytes of an arena chunk */
+
+struct arena;
+
+extern unsigned long arenachunks, arenaorphans;
+
+extern int  arenaInstall(void);
+extern struct arena *arenaNew(void);
+extern struct arena *arenaUse(struct arena *arena);
+extern void arenaRelease(struct arena *arena);
@@ -0,0 +1,333 @@
+/*
+ * nciddbook.c - This file is part of ncidd.
+ *
+ * LA: local phonebook, names for known numbers without a lookup
+ *
+ * The phonebook is a file of numbers and names sorted by the tidy
+ * number, memory mapped, and searched by bisection, so a list of
+ * several hundred thousand numbers costs no memory of its own and no
+ * time to load.  The file is made from a text list by hittabook, which
+ * writes a new file and renames it over the old one; the file is
+ * checked every BOOKCHECK seconds and mapped again when it changed, so
+ * a new list is used without a restart.
+ *
+ * phonebook file:
+ *   BOOKMAGIC (8) count (4) offset (4) * count
+ *   at each offset: nmbr '\0' name '\0'
+ * the offsets are from the start of the file, in the order of the numbers
+ *
+ * ncidd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ncidd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ncidd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ncidd.h"
+#include "nciddbook.h"
+#include <sys/mman.h>
+#include <stdint.h>
+
+#define BOOKMAGIC   "NCIDPB1\n"
+#define BOOKMAGLEN  8
+#define BOOKHEAD    (BOOKMAGLEN + 4)
+
+char *bookfile = BOOKFILE;
+
+static char *bookmap;
+static size_t booklen;
+static uint32_t bookcount;
+static uint32_t *bookindex;
+static struct stat bookstat;        /* of the file mapped */
+static time_t bookchecked;
+
+/* the number at an index of the file */
+#define BOOKNMBR(i) (bookmap + bookindex[i])
+
+/*
+ * Map the phonebook file, a missing file is not an error
+ * returns 0, or -1 if there is no phonebook
+ */
+int bookOpen()
+{
+    uint32_t i;
+    int fd, ok;
+    char *end, msgbuf[BUFSIZ];
+
+    bookClose();
+    bookchecked = time(0);
+
+    if ((fd = open(bookfile, O_RDONLY)) < 0 || fstat(fd, &bookstat) < 0)
+    {
+        if (errno != ENOENT)
+        {
+            sprintf(msgbuf, "%s: %s\n", bookfile, strerror(errno));
+            logMsg(LEVEL1, msgbuf);
+        }
+        if (fd >= 0) close(fd);
+        memset(&bookstat, 0, sizeof(bookstat));
+        return -1;
+    }
+
+    booklen = bookstat.st_size;
+    if (booklen >= BOOKHEAD)
+        bookmap = mmap(0, booklen, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (!bookmap || bookmap == MAP_FAILED)
+    {
+        bookmap = 0;
+        sprintf(msgbuf, "Not a phonebook file, not used: %s\n", bookfile);
+        logMsg(LEVEL1, msgbuf);
+        return -1;
+    }
+
+    /* every entry must be in the file, with both strings ended */
+    memcpy(&bookcount, bookmap + BOOKMAGLEN, 4);
+    bookindex = (uint32_t *) (bookmap + BOOKHEAD);
+    ok = !memcmp(bookmap, BOOKMAGIC, BOOKMAGLEN) &&
+         bookcount <= (booklen - BOOKHEAD) / 4;
+    for (i = 0; ok && i < bookcount; ++i)
+    {
+        ok = bookindex[i] >= BOOKHEAD + bookcount * 4 &&
+             bookindex[i] < booklen &&
+             (end = memchr(BOOKNMBR(i), 0, booklen - bookindex[i])) &&
+             memchr(end + 1, 0, bookmap + booklen - end - 1);
+    }
+    if (!ok)
+    {
+        sprintf(msgbuf, "Not a phonebook file, not used: %s\n", bookfile);
+        logMsg(LEVEL1, msgbuf);
+        bookClose();
+        return -1;
+    }
+
+    sprintf(msgbuf, "Phonebook: %s, %lu numbers, %lu bytes\n",
+        bookfile, (unsigned long) bookcount, (unsigned long) booklen);
+    logMsg(LEVEL1, msgbuf);
+
+    return 0;
+}
+
+void bookClose()
+{
+    if (bookmap) munmap(bookmap, booklen);
+    bookmap = 0;
+    bookindex = 0;
+    bookcount = 0;
+    booklen = 0;
+}
+
+/* map the file again if hittabook replaced it */
+static void bookCheck()
+{
+    struct stat statbuf;
+    time_t now = time(0);
+
+    if (now - bookchecked < BOOKCHECK) return;
+    bookchecked = now;
+
+    if (stat(bookfile, &statbuf) < 0)
+    {
+        if (bookmap) bookClose();
+        memset(&bookstat, 0, sizeof(bookstat));
+        return;
+    }
+    if (statbuf.st_ino != bookstat.st_ino ||
+        statbuf.st_dev != bookstat.st_dev ||
+        statbuf.st_mtime != bookstat.st_mtime ||
+        statbuf.st_size != bookstat.st_size) (void) bookOpen();
+}
+
+/*
+ * Look for a number in the phonebook
+ * returns 1 and copies the name, or 0 if it is not there
+ */
+int bookFind(char *nmbr, char *name)
+{
+    uint32_t lo, hi, mid;
+    int cmp;
+
+    bookCheck();
+    if (!bookmap) return 0;
+
+    for (lo = 0, hi = bookcount; lo < hi; )
+    {
+        mid = lo + (hi - lo) / 2;
+        if (!(cmp = strcmp(nmbr, BOOKNMBR(mid))))
+        {
+            strncpy(name, BOOKNMBR(mid) + strlen(BOOKNMBR(mid)) + 1,
+                CIDSIZE - 1);
+            return 1;
+        }
+        if (cmp < 0) hi = mid;
+        else lo = mid + 1;
+    }
+
+    return 0;
+}
+
+/* a number and its name from the list */
+struct bookline
+{
+    char *nmbr;
+    char *name;
+    size_t seq;                     /* line, the last one of a number wins */
+};
+
+static int compareLine(const void *a, const void *b)
+{
+    const struct bookline *x = a, *y = b;
+    int cmp = strcmp(x->nmbr, y->nmbr);
+
+    if (cmp) return cmp;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static void freeLines(struct bookline *lines, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; ++i)
+    {
+        free(lines[i].nmbr);
+        free(lines[i].name);
+    }
+    free(lines);
+}
+
+/*
+ * Read the list, a line is a number, a tab or a ';', and the name;
+ * empty lines and lines that start with '#' are skipped
+ * returns the lines in *lines, or -1 with errno set
+ */
+static long readLines(FILE *in, struct bookline **lines,
+    void (*tidy)(char *nmbr))
+{
+    struct bookline *lp;
+    size_t count = 0, max = 0;
+    char buf[BUFSIZ], nmbr[CIDSIZE], *sep, *end;
+
+    *lines = 0;
+    while (fgets(buf, sizeof(buf), in))
+    {
+        buf[strcspn(buf, "\r\n")] = 0;
+        if (!*buf || *buf == '#') continue;
+        if (!(sep = strpbrk(buf, "\t;")) || sep == buf ||
+            sep - buf >= CIDSIZE) continue;
+        *sep++ = 0;
+        for (end = sep + strlen(sep); end > sep && end[-1] == ' '; --end);
+        *end = 0;
+        while (*sep == ' ') ++sep;
+        if (!*sep) continue;
+
+        strcpy(nmbr, buf);
+        if (tidy) tidy(nmbr);
+
+        if (count == max)
+        {
+            max = max ? max * 2 : 4096;
+            if (!(lp = realloc(*lines, max * sizeof(struct bookline))))
+                break;
+            *lines = lp;
+        }
+        lp = &(*lines)[count];
+        lp->seq = count;
+        lp->name = 0;
+        if (!(lp->nmbr = strdup(nmbr)) ||
+            !(lp->name = strndup(sep, CIDSIZE - 1)))
+        {
+            free(lp->nmbr);
+            break;
+        }
+        ++count;
+    }
+    if (!feof(in) || ferror(in))
+    {
+        freeLines(*lines, count);
+        *lines = 0;
+        return -1;
+    }
+
+    return (long) count;
+}
+
+/* write the lines to a new file, and rename it to file */
+static int writeBook(struct bookline *lines, size_t count, char *file)
+{
+    char newfile[BUFSIZ];
+    uint32_t offset, total = count;
+    size_t i;
+    FILE *fp;
+    int ok, err;
+
+    sprintf(newfile, "%s.new", file);
+    if (!(fp = fopen(newfile, "w"))) return -1;
+
+    offset = BOOKHEAD + total * 4;
+    ok = fwrite(BOOKMAGIC, BOOKMAGLEN, 1, fp) == 1 &&
+         fwrite(&total, 4, 1, fp) == 1;
+    for (i = 0; ok && i < count; ++i)
+    {
+        ok = fwrite(&offset, 4, 1, fp) == 1;
+        offset += strlen(lines[i].nmbr) + strlen(lines[i].name) + 2;
+    }
+    for (i = 0; ok && i < count; ++i)
+        ok = fwrite(lines[i].nmbr, strlen(lines[i].nmbr) + 1, 1, fp) == 1 &&
+             fwrite(lines[i].name, strlen(lines[i].name) + 1, 1, fp) == 1;
+    ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    if (fclose(fp) != 0) ok = 0;
+
+    if (!ok || rename(newfile, file) < 0)
+    {
+        err = errno;
+        unlink(newfile);
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Make a phonebook file from a list, the numbers made tidy by tidy;
+ * the file is written next to file and renamed to it when complete,
+ * so ncidd never maps a part of it
+ * returns the numbers written, or -1 with errno set
+ */
+int bookBuild(FILE *in, char *file, void (*tidy)(char *nmbr))
+{
+    struct bookline *lines;
+    long count;
+    size_t i, n;
+    int ret;
+
+    if ((count = readLines(in, &lines, tidy)) < 0) return -1;
+
+    /* by number, and of each number only its last line */
+    qsort(lines, count, sizeof(struct bookline), compareLine);
+    for (n = i = 0; i < (size_t) count; ++i)
+    {
+        if (i + 1 < (size_t) count &&
+            !strcmp(lines[i].nmbr, lines[i + 1].nmbr))
+        {
+            free(lines[i].nmbr);
+            free(lines[i].name);
+            continue;
+        }
+        lines[n++] = lines[i];
+    }
+
+    ret = writeBook(lines, n, file) < 0 ? -1 : (int) n;
+    i = errno;
+    freeLines(lines, n);
+    errno = i;
+
+    return ret;
+}
@@ -0,0 +1,33 @@
+/*
+ * nciddbook.h - This file is part of ncidd.
+ *
+ * LA: local phonebook, names for known numbers without a lookup
+ *
+ * ncidd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ncidd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ncidd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define BOOKCHECK       10          /* seconds between checks for a new file */
+
+#ifndef BOOKFILE
+#define BOOKFILE        "/usr/local/etc/ncid/hitta.book"
+#endif
+
+extern void logMsg();
+
+extern char *bookfile;
+
+extern int  bookOpen(void);
+extern void bookClose(void);
+extern int  bookFind(char *nmbr, char *name);
+extern int  bookBuild(FILE *in, char *file, void (*tidy)(char *nmbr));
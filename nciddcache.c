@@ -0,0 +1,854 @@
+/*
+ * nciddcache.c - This file is part of ncidd.
+ *
+ * LA: number to name cache for the hitta.se lookups
+ *
+ * The cache is a hash table keyed by the tidy number from hittaAlias(),
+ * with all entries also on a list from the most to the least recently
+ * used.  An entry expires after a time that depends on its result class,
+ * and the least recently used entries are removed when either the number
+ * of entries or the bytes they use would go over the limit.
+ *
+ * Names are also appended to a cache file, next to cidcall.log, so they
+ * survive a restart.  The file is memory mapped and indexed by number,
+ * it is checked when a number is not in memory.  Each record has a
+ * checksum, a record only partly written by a crash is cut off when the
+ * file is opened.  When most of the file is old records for numbers
+ * written again, or expired records, the file is compacted to a new file
+ * that replaces it.  Writing and syncing the new file blocks, so it is
+ * only done by cacheCompact() while ncidd is idle.
+ *
+ * Each entry counts its hits, and a call line read from the log counts
+ * as one.  cacheRefresh() finds the numbers called often whose names
+ * are close to expiring, so they can be looked up again while ncidd is
+ * idle, and a name does not make way for a failed lookup while valid.
+ * It looks at CACHESCAN entries each time, from where it stopped, so an
+ * idle time out does not walk the whole cache.
+ *
+ * The cache can also be seeded at start from the names in cidcall.log.
+ * The log is read a few lines at a time from the poll() loop, so calls
+ * are served while it is read.  Only CID lines are read, and a class
+ * function decides which of their names are hitta.se names, and which
+ * are texts for an unknown number; an alias or a list name is skipped.
+ * A later line replaces an earlier one, and a line older than the TTL
+ * of its class or than the cached name is skipped.
+ *
+ * ncidd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ncidd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ncidd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ncidd.h"
+#include "nciddcache.h"
+#include <sys/mman.h>
+
+int cachemax     = CACHEMAX;
+int cachebytes   = CACHEBYTES;
+int cachettl     = CACHETTL;
+int cacheunknown = CACHEUNKNOWN;
+int cacheerror   = CACHEERROR;
+int cachewarm    = CACHEWARM;
+int cachehot     = CACHEHOT;
+int cacheahead   = CACHEAHEAD;
+char *cachefile  = CACHEFILE;
+
+unsigned long cachehits, cachemisses;
+
+struct entry
+{
+    struct entry *hnext;            /* next in the hash bucket */
+    struct entry *prev, *next;      /* LRU list, head is most recent */
+    time_t fetched;
+    time_t tried;                   /* when cacheRefresh() last gave it */
+    int class;
+    int hits;                       /* calls for the number */
+    int size;                       /* bytes malloc'ed for the entry */
+    char *name;
+    char nmbr[1];                   /* name follows the number */
+};
+
+static struct entry **table, *head, *tail;
+static struct entry *cursor;        /* where cacheRefresh() goes on */
+static unsigned int tablemask;
+static int entries, bytes;
+
+/*
+ * cache file record:
+ *   checksum (4) fetched (8) class (1) nmbr length (1) name length (1)
+ *   nmbr '\0' name '\0'
+ * the checksum covers all of the record after it
+ */
+#define DISKMAGIC   "NCIDHC1\n"
+#define DISKMAGLEN  8
+#define DISKHEAD    15
+#define DISKMIN     65536       /* do not compact a smaller file */
+#define DISKSLACK   1048576     /* map this much past the end of file */
+
+struct record
+{
+    long long fetched;
+    int class;
+    int size;
+    char *nmbr;
+    char *name;
+};
+
+struct slot
+{
+    struct slot *next;
+    size_t offset;              /* latest record for a number */
+};
+
+/* cidcall.log being read by cacheWarmStep() */
+static FILE *warmfp;
+static void (*warmtidy)(char *nmbr);
+static int (*warmclass)(char *nmbr, char *name);
+static int warmlines, warmnames;
+
+static int diskfd = -1;
+static char *diskmap;
+static size_t disklen;          /* bytes mapped */
+static size_t disksize;         /* bytes in the file */
+static size_t disklive;         /* bytes in the latest unexpired records */
+static struct slot **disktable;
+static unsigned int diskmask;
+static int diskcount;
+
+static void memStore(char *nmbr, char *name, int class, time_t fetched);
+
+/* FNV-1a */
+static unsigned int hash(char *nmbr)
+{
+    unsigned int h = 2166136261U;
+
+    while (*nmbr) h = (h ^ (unsigned char) *nmbr++) * 16777619U;
+    return h;
+}
+
+static unsigned int checksum(char *ptr, int len)
+{
+    unsigned int h = 2166136261U;
+
+    while (len--) h = (h ^ (unsigned char) *ptr++) * 16777619U;
+    return h;
+}
+
+static int ttl(int class)
+{
+    switch (class)
+    {
+        case CACHE_NAME:
+            return cachettl;
+        case CACHE_UNKNOWN:
+            return cacheunknown;
+        default:
+            return cacheerror;
+    }
+}
+
+/* the bytes of a record that count as live, 0 if it expired */
+static size_t liveSize(struct record *rp)
+{
+    return time(0) - rp->fetched < ttl(rp->class) ? rp->size : 0;
+}
+
+/*
+ * Check a record in the cache file
+ * returns its size, or 0 if it is not a complete record
+ */
+static int readRecord(char *ptr, size_t left, struct record *rp)
+{
+    unsigned int sum;
+    int nlen, alen, size;
+
+    if (left < DISKHEAD) return 0;
+    nlen = (unsigned char) ptr[13];
+    alen = (unsigned char) ptr[14];
+    size = DISKHEAD + nlen + 1 + alen + 1;
+    if ((size_t) size > left) return 0;
+
+    memcpy(&sum, ptr, 4);
+    if (sum != checksum(ptr + 4, size - 4)) return 0;
+    if (ptr[DISKHEAD + nlen] || ptr[size - 1]) return 0;
+
+    memcpy(&rp->fetched, ptr + 4, 8);
+    rp->class = ptr[12];
+    rp->size = size;
+    rp->nmbr = ptr + DISKHEAD;
+    rp->name = ptr + DISKHEAD + nlen + 1;
+
+    return size;
+}
+
+/* map the cache file, with room for it to grow */
+static int diskMap(size_t need)
+{
+    if (diskmap && need <= disklen) return 0;
+    if (diskmap) munmap(diskmap, disklen);
+    disklen = need + DISKSLACK;
+    diskmap = mmap(0, disklen, PROT_READ, MAP_SHARED, diskfd, 0);
+    if (diskmap == MAP_FAILED)
+    {
+        diskmap = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static struct slot *diskFind(char *nmbr)
+{
+    struct slot *sp;
+    struct record rec;
+
+    for (sp = disktable[hash(nmbr) & diskmask]; sp; sp = sp->next)
+    {
+        readRecord(diskmap + sp->offset, disksize - sp->offset, &rec);
+        if (!strcmp(rec.nmbr, nmbr)) break;
+    }
+    return sp;
+}
+
+/* index a record, it replaces any older record for the number */
+static int diskIndex(struct record *rp, size_t offset)
+{
+    struct slot *sp, **table2;
+    struct record rec;
+    unsigned int size, i;
+
+    if ((sp = diskFind(rp->nmbr)))
+    {
+        readRecord(diskmap + sp->offset, disksize - sp->offset, &rec);
+        disklive -= liveSize(&rec);
+        sp->offset = offset;
+        disklive += liveSize(rp);
+        return 0;
+    }
+
+    if ((unsigned) diskcount >= diskmask + 1)
+    {
+        /* grow the index */
+        size = (diskmask + 1) * 2;
+        if (!(table2 = (struct slot **) calloc(size, sizeof(struct slot *))))
+            return -1;
+        for (i = 0; i <= diskmask; ++i)
+        {
+            while ((sp = disktable[i]))
+            {
+                disktable[i] = sp->next;
+                readRecord(diskmap + sp->offset, disksize - sp->offset, &rec);
+                sp->next = table2[hash(rec.nmbr) & (size - 1)];
+                table2[hash(rec.nmbr) & (size - 1)] = sp;
+            }
+        }
+        free(disktable);
+        disktable = table2;
+        diskmask = size - 1;
+    }
+
+    if (!(sp = (struct slot *) malloc(sizeof(struct slot)))) return -1;
+    sp->offset = offset;
+    sp->next = disktable[hash(rp->nmbr) & diskmask];
+    disktable[hash(rp->nmbr) & diskmask] = sp;
+    ++diskcount;
+    disklive += liveSize(rp);
+
+    return 0;
+}
+
+static void diskClose()
+{
+    struct slot *sp;
+    unsigned int i;
+
+    if (disktable)
+    {
+        for (i = 0; i <= diskmask; ++i)
+        {
+            while ((sp = disktable[i]))
+            {
+                disktable[i] = sp->next;
+                free(sp);
+            }
+        }
+        free(disktable);
+        disktable = 0;
+    }
+    if (diskmap) munmap(diskmap, disklen);
+    diskmap = 0;
+    if (diskfd >= 0) close(diskfd);
+    diskfd = -1;
+    diskcount = 0;
+    disksize = disklive = 0;
+}
+
+/*
+ * Open the cache file and index it
+ * a record cut short by a crash, and anything after it, is removed
+ */
+static int diskOpen()
+{
+    struct stat statbuf;
+    struct record rec;
+    size_t offset;
+    int size;
+    char msgbuf[BUFSIZ];
+
+    if ((diskfd = open(cachefile, O_RDWR | O_APPEND | O_CREAT,
+         S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) < 0 ||
+        fstat(diskfd, &statbuf) < 0)
+    {
+        sprintf(msgbuf, "%s: %s\n", cachefile, strerror(errno));
+        logMsg(LEVEL1, msgbuf);
+        diskClose();
+        return -1;
+    }
+    disksize = statbuf.st_size;
+
+    if (disksize < DISKMAGLEN)
+    {
+        /* new file */
+        if (ftruncate(diskfd, 0) < 0 ||
+            write(diskfd, DISKMAGIC, DISKMAGLEN) != DISKMAGLEN)
+        {
+            sprintf(msgbuf, "%s: %s\n", cachefile, strerror(errno));
+            logMsg(LEVEL1, msgbuf);
+            diskClose();
+            return -1;
+        }
+        disksize = DISKMAGLEN;
+    }
+
+    if (!(disktable = (struct slot **) calloc(256, sizeof(struct slot *))) ||
+        diskMap(disksize) < 0)
+    {
+        sprintf(msgbuf, "%s: %s\n", cachefile, strerror(errno));
+        logMsg(LEVEL1, msgbuf);
+        diskClose();
+        return -1;
+    }
+    diskmask = 255;
+
+    if (memcmp(diskmap, DISKMAGIC, DISKMAGLEN))
+    {
+        sprintf(msgbuf, "Not a name cache file, not used: %s\n", cachefile);
+        logMsg(LEVEL1, msgbuf);
+        diskClose();
+        return -1;
+    }
+
+    for (offset = DISKMAGLEN; offset < disksize; offset += size)
+    {
+        if (!(size = readRecord(diskmap + offset, disksize - offset, &rec)))
+            break;
+        diskIndex(&rec, offset);
+    }
+
+    if (offset < disksize)
+    {
+        sprintf(msgbuf, "Removed %lu bytes of a damaged record from %s\n",
+            (unsigned long) (disksize - offset), cachefile);
+        logMsg(LEVEL1, msgbuf);
+        if (ftruncate(diskfd, offset) < 0)
+        {
+            diskClose();
+            return -1;
+        }
+        disksize = offset;
+    }
+
+    sprintf(msgbuf, "Name cache file: %s, %d numbers, %lu bytes\n",
+        cachefile, diskcount, (unsigned long) disksize);
+    logMsg(LEVEL1, msgbuf);
+
+    return 0;
+}
+
+/*
+ * Write the latest, unexpired, record of each number to a new file
+ * and replace the cache file with it
+ */
+static void diskCompact()
+{
+    struct slot *sp;
+    struct record rec;
+    unsigned int i;
+    time_t now = time(0);
+    char newfile[BUFSIZ], msgbuf[BUFSIZ];
+    FILE *fp;
+    int ok;
+
+    sprintf(newfile, "%s.new", cachefile);
+    if (!(fp = fopen(newfile, "w")))
+    {
+        sprintf(msgbuf, "%s: %s\n", newfile, strerror(errno));
+        logMsg(LEVEL1, msgbuf);
+        return;
+    }
+
+    ok = fwrite(DISKMAGIC, DISKMAGLEN, 1, fp) == 1;
+    for (i = 0; ok && i <= diskmask; ++i)
+    {
+        for (sp = disktable[i]; ok && sp; sp = sp->next)
+        {
+            readRecord(diskmap + sp->offset, disksize - sp->offset, &rec);
+            if (now - rec.fetched >= ttl(rec.class)) continue;
+            ok = fwrite(diskmap + sp->offset, rec.size, 1, fp) == 1;
+        }
+    }
+    ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    if (fclose(fp) != 0) ok = 0;
+
+    if (!ok || rename(newfile, cachefile) < 0)
+    {
+        sprintf(msgbuf, "Cannot compact %s: %s\n", cachefile, strerror(errno));
+        logMsg(LEVEL1, msgbuf);
+        unlink(newfile);
+        return;
+    }
+
+    sprintf(msgbuf, "Compacted name cache file: %s [%s]\n",
+        cachefile, strdate(ONLYTIME));
+    logMsg(LEVEL3, msgbuf);
+
+    diskClose();
+    (void) diskOpen();
+}
+
+/* append a record to the cache file */
+static void diskStore(char *nmbr, char *name, int class, time_t fetched)
+{
+    char buf[DISKHEAD + 2 * CIDSIZE];
+    long long when = fetched;
+    struct record rec;
+    unsigned int sum;
+    int nlen, alen, size;
+
+    nlen = strlen(nmbr);
+    alen = strlen(name);
+    if (nlen >= CIDSIZE || alen >= CIDSIZE) return;
+    size = DISKHEAD + nlen + 1 + alen + 1;
+
+    memcpy(buf + 4, &when, 8);
+    buf[12] = class;
+    buf[13] = nlen;
+    buf[14] = alen;
+    strcpy(buf + DISKHEAD, nmbr);
+    strcpy(buf + DISKHEAD + nlen + 1, name);
+    sum = checksum(buf + 4, size - 4);
+    memcpy(buf, &sum, 4);
+
+    /* a single write, a crash can only leave a short record at the end */
+    if (write(diskfd, buf, size) != size)
+    {
+        if (ftruncate(diskfd, disksize) < 0) diskClose();
+        return;
+    }
+    disksize += size;
+    if (diskMap(disksize) < 0)
+    {
+        diskClose();
+        return;
+    }
+
+    readRecord(diskmap + disksize - size, size, &rec);
+    diskIndex(&rec, disksize - size);
+}
+
+static void unlink_lru(struct entry *ep)
+{
+    if (cursor == ep) cursor = ep->next;
+    if (ep->prev) ep->prev->next = ep->next;
+    else head = ep->next;
+    if (ep->next) ep->next->prev = ep->prev;
+    else tail = ep->prev;
+}
+
+static void push_lru(struct entry *ep)
+{
+    ep->prev = 0;
+    ep->next = head;
+    if (head) head->prev = ep;
+    else tail = ep;
+    head = ep;
+}
+
+static void removeEntry(struct entry *ep)
+{
+    struct entry **epp;
+
+    for (epp = &table[hash(ep->nmbr) & tablemask]; *epp != ep;
+         epp = &(*epp)->hnext);
+    *epp = ep->hnext;
+    unlink_lru(ep);
+    --entries;
+    bytes -= ep->size;
+    free(ep);
+}
+
+int cacheInit()
+{
+    unsigned int size;
+    char msgbuf[BUFSIZ];
+
+    /* about two buckets for each entry */
+    for (size = 16; size < (unsigned) cachemax * 2; size <<= 1);
+    if (!(table = (struct entry **) calloc(size, sizeof(struct entry *))))
+        return -1;
+    tablemask = size - 1;
+
+    sprintf(msgbuf,
+        "Name cache: %d entries, %d bytes, keeps names %ds, unknown %ds, errors %ds\n",
+        cachemax, cachebytes, cachettl, cacheunknown, cacheerror);
+    logMsg(LEVEL1, msgbuf);
+
+    /* without the cache file only the names in memory are cached */
+    if (*cachefile) (void) diskOpen();
+
+    return 0;
+}
+
+void cacheCleanup()
+{
+    if (warmfp) fclose(warmfp);
+    warmfp = 0;
+    diskClose();
+    while (head) removeEntry(head);
+    free(table);
+    table = 0;
+}
+
+/*
+ * Look for a number in the cache
+ * returns the result class and copies the name, or -1 if not found
+ */
+int cacheFind(char *nmbr, char *name)
+{
+    struct entry *ep;
+    struct slot *sp;
+    struct record rec;
+
+    if (table == 0) return -1;
+
+    for (ep = table[hash(nmbr) & tablemask]; ep; ep = ep->hnext)
+        if (!strcmp(ep->nmbr, nmbr)) break;
+
+    if (ep && time(0) - ep->fetched >= ttl(ep->class))
+    {
+        /* expired */
+        removeEntry(ep);
+        ep = 0;
+    }
+
+    if (ep == 0 && diskmap && (sp = diskFind(nmbr)))
+    {
+        /* not in memory, but in the cache file */
+        readRecord(diskmap + sp->offset, disksize - sp->offset, &rec);
+        if (time(0) - rec.fetched < ttl(rec.class))
+        {
+            memStore(rec.nmbr, rec.name, rec.class, (time_t) rec.fetched);
+            if (head && !strcmp(head->nmbr, nmbr)) ep = head;
+        }
+    }
+
+    if (ep == 0)
+    {
+        ++cachemisses;
+        return -1;
+    }
+
+    /* most recently used */
+    if (ep != head)
+    {
+        unlink_lru(ep);
+        push_lru(ep);
+    }
+    strncpy(name, ep->name, CIDSIZE - 1);
+    ++ep->hits;
+    ++cachehits;
+
+    return ep->class;
+}
+
+/*
+ * Add or replace a number in the cache
+ * errors are only kept in memory
+ */
+void cacheStore(char *nmbr, char *name, int class, time_t fetched)
+{
+    memStore(nmbr, name, class, fetched);
+    if (diskmap && class != CACHE_ERROR && ttl(class) > 0)
+        diskStore(nmbr, name, class, fetched);
+}
+
+static void memStore(char *nmbr, char *name, int class, time_t fetched)
+{
+    struct entry *ep, **epp;
+    int len, size, hits = 0;
+
+    if (table == 0 || cachemax <= 0 || ttl(class) <= 0) return;
+
+    len = strlen(nmbr);
+    size = sizeof(struct entry) + len + strlen(name) + 1;
+    if (size > cachebytes) return;
+
+    epp = &table[hash(nmbr) & tablemask];
+    for (ep = *epp; ep; ep = ep->hnext)
+    {
+        if (!strcmp(ep->nmbr, nmbr))
+        {
+            /* a failed refresh keeps the name until it expires */
+            if (class == CACHE_ERROR && ep->class != CACHE_ERROR &&
+                time(0) - ep->fetched < ttl(ep->class)) return;
+            hits = ep->hits;
+            removeEntry(ep);
+            break;
+        }
+    }
+
+    /* make room, least recently used first */
+    while (tail && (entries >= cachemax || bytes + size > cachebytes))
+        removeEntry(tail);
+
+    if (!(ep = (struct entry *) malloc(size))) return;
+    ep->fetched = fetched;
+    ep->tried = 0;
+    ep->class = class;
+    ep->hits = hits;
+    ep->size = size;
+    strcpy(ep->nmbr, nmbr);
+    ep->name = ep->nmbr + len + 1;
+    strcpy(ep->name, name);
+
+    ep->hnext = *epp;
+    *epp = ep;
+    push_lru(ep);
+    ++entries;
+    bytes += size;
+}
+
+/*
+ * Start to seed the cache from the call log, tidy makes the numbers
+ * look like those from hittaAlias(), and class gives the result class
+ * of a name as it is in the log, or -1 if it is not from a lookup
+ * returns 1 if cacheWarmStep() has lines to read, 0 if not
+ */
+int cacheWarm(char *logfile, void (*tidy)(char *nmbr),
+              int (*class)(char *nmbr, char *name))
+{
+    char msgbuf[BUFSIZ];
+
+    if (table == 0 || cachemax <= 0 || cachettl <= 0) return 0;
+
+    if (!(warmfp = fopen(logfile, "r")))
+    {
+        sprintf(msgbuf, "%s: %s\n", logfile, strerror(errno));
+        logMsg(LEVEL1, msgbuf);
+        return 0;
+    }
+    warmtidy = tidy;
+    warmclass = class;
+    warmlines = warmnames = 0;
+
+    sprintf(msgbuf, "Name cache reading %s [%s]\n", logfile, strdate(ONLYTIME));
+    logMsg(LEVEL3, msgbuf);
+
+    return 1;
+}
+
+/*
+ * Get a field of a call log line, ending at the next '*'
+ * returns 0, or -1 if the field is not there
+ */
+static int warmField(char *line, char *label, char *field)
+{
+    char *ptr, *end;
+
+    if (!(ptr = strstr(line, label))) return -1;
+    ptr += strlen(label);
+    if (!(end = strchr(ptr, '*')) || end - ptr >= CIDSIZE) return -1;
+    strncpy(field, ptr, end - ptr);
+    field[end - ptr] = 0;
+
+    return 0;
+}
+
+/* the time of a call log line, or -1 if it has none */
+static time_t warmTime(char *line)
+{
+    char date[CIDSIZE], hhmm[CIDSIZE];
+    struct tm tm;
+
+    if (warmField(line, DATE, date) || warmField(line, TIME, hhmm)) return -1;
+    if (strlen(date) != 8 || strlen(hhmm) != 4) return -1;
+
+    /* DATE is mmddyyyy, TIME is hhmm */
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(date, "%2d%2d%4d", &tm.tm_mon, &tm.tm_mday, &tm.tm_year) != 3 ||
+        sscanf(hhmm, "%2d%2d", &tm.tm_hour, &tm.tm_min) != 2) return -1;
+    tm.tm_mon -= 1;
+    tm.tm_year -= 1900;
+    tm.tm_isdst = -1;
+
+    return mktime(&tm);
+}
+
+/* a name from the call log, unless the cache has a later one */
+static void warmStore(char *nmbr, char *name, int class, time_t fetched)
+{
+    struct entry *ep;
+    struct slot *sp;
+    struct record rec;
+
+    for (ep = table[hash(nmbr) & tablemask]; ep; ep = ep->hnext)
+        if (!strcmp(ep->nmbr, nmbr)) break;
+    if (ep && ep->fetched > fetched)
+    {
+        /* the call counts even if the name does not */
+        ++ep->hits;
+        return;
+    }
+
+    if (!ep && diskmap && (sp = diskFind(nmbr)))
+    {
+        readRecord(diskmap + sp->offset, disksize - sp->offset, &rec);
+        if (rec.fetched > fetched) return;
+    }
+
+    memStore(nmbr, name, class, fetched);
+    if (head && !strcmp(head->nmbr, nmbr)) ++head->hits;
+    ++warmnames;
+}
+
+/*
+ * Read the next CACHEWARMLINES lines of the call log into the cache
+ * returns 1 if there are more lines, 0 when the log is read
+ */
+int cacheWarmStep()
+{
+    char line[BUFSIZ], nmbr[CIDSIZE], name[CIDSIZE], msgbuf[BUFSIZ];
+    time_t fetched, now = time(0);
+    int lines, class;
+
+    if (!warmfp) return 0;
+
+    for (lines = 0; lines < CACHEWARMLINES; ++lines)
+    {
+        if (!fgets(line, sizeof(line), warmfp))
+        {
+            fclose(warmfp);
+            warmfp = 0;
+            sprintf(msgbuf,
+                "Name cache read %d names from %d call log lines [%s]\n",
+                warmnames, warmlines, strdate(ONLYTIME));
+            logMsg(LEVEL1, msgbuf);
+            return 0;
+        }
+        ++warmlines;
+
+        /*
+         * only incoming calls have the name of the caller, a HUP or
+         * BLK line has the blacklist entry that matched instead
+         */
+        if (strncmp(line, CIDLINE, strlen(CIDLINE))) continue;
+
+        if (warmField(line, NMBR, nmbr) || warmField(line, NAME, name))
+            continue;
+        if (!*name || !strcmp(name, NONAME) || !strncmp(name, "Error", 5))
+            continue;
+        class = warmclass ? warmclass(nmbr, name) : CACHE_NAME;
+        if (class < 0 || class == CACHE_ERROR) continue;
+        if ((fetched = warmTime(line)) < 0 || now - fetched >= ttl(class))
+            continue;
+
+        if (warmtidy) warmtidy(nmbr);
+        warmStore(nmbr, name, class, fetched);
+    }
+
+    return 1;
+}
+
+/*
+ * Compact the cache file if less than half of it is live records, at
+ * most each CACHECOMPACT seconds; the records that expired since they
+ * were indexed are counted again first.  diskCompact() writes and syncs
+ * the new file before the poll() loop goes on, so ncidd calls this
+ * when poll() times out idle.
+ */
+void cacheCompact()
+{
+    static time_t compacted;
+    struct slot *sp;
+    struct record rec;
+    unsigned int i;
+    time_t now = time(0);
+
+    if (!diskmap || now - compacted < CACHECOMPACT) return;
+    compacted = now;
+
+    disklive = 0;
+    for (i = 0; i <= diskmask; ++i)
+    {
+        for (sp = disktable[i]; sp; sp = sp->next)
+        {
+            readRecord(diskmap + sp->offset, disksize - sp->offset, &rec);
+            disklive += liveSize(&rec);
+        }
+    }
+
+    if (disksize > DISKMIN && disksize > 2 * disklive) diskCompact();
+}
+
+/*
+ * Find a number called at least cachehot times whose name has less than
+ * cacheahead percent of its TTL left, to look it up again before a call
+ * has to wait for it; a number is not given again for cacheerror seconds
+ * once cacheRefreshed() says its lookup started.  At most CACHESCAN
+ * entries are looked at, on from the last one, most recently used first,
+ * and from the head again after the tail.
+ * returns 1 and copies the number, 0 if there is none
+ */
+int cacheRefresh(char *nmbr)
+{
+    struct entry *ep;
+    time_t now = time(0);
+    long left;
+    int scanned;
+
+    if (table == 0 || cacheahead <= 0) return 0;
+
+    for (scanned = 0; scanned < CACHESCAN && head; ++scanned)
+    {
+        if (!(ep = cursor)) ep = head;
+        cursor = ep->next;
+
+        if (ep->class == CACHE_ERROR || ep->hits < cachehot) continue;
+        if (ep->tried && now - ep->tried < cacheerror) continue;
+        left = ttl(ep->class) - (long) (now - ep->fetched);
+        if (left <= 0 || left > (long) ttl(ep->class) * cacheahead / 100)
+            continue;
+        strcpy(nmbr, ep->nmbr);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* the lookup of a number from cacheRefresh() started */
+void cacheRefreshed(char *nmbr)
+{
+    struct entry *ep;
+
+    if (table == 0) return;
+    for (ep = table[hash(nmbr) & tablemask]; ep; ep = ep->hnext)
+        if (!strcmp(ep->nmbr, nmbr)) break;
+    if (ep) ep->tried = time(0);
+}
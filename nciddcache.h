@@ -0,0 +1,59 @@
+/*
+ * nciddcache.h - This file is part of ncidd.
+ *
+ * LA: number to name cache for the hitta.se lookups
+ *
+ * ncidd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ncidd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ncidd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* result class of a lookup, kept with the name */
+#define CACHE_NAME      0   /* name found */
+#define CACHE_UNKNOWN   1   /* hitta.se: Okänt nummer */
+#define CACHE_ERROR     2   /* lookup or parse failed */
+
+/* defaults, all can be changed with --hitta word=value */
+#define CACHEMAX        10000       /* entries */
+#define CACHEBYTES      1048576     /* bytes used by the entries */
+#define CACHETTL        604800      /* seconds a name is kept, 7 days */
+#define CACHEUNKNOWN    86400       /* seconds Okänt nummer is kept, 1 day */
+#define CACHEERROR      300         /* seconds an error is kept */
+#define CACHEWARM       0           /* 1 reads the names in cidcall.log at start */
+#define CACHEWARMLINES  256         /* log lines read each time through poll() */
+#define CACHEHOT        2           /* hits that make a number called often */
+#define CACHEAHEAD      10          /* percent of its TTL left when it is refreshed */
+#define CACHECOMPACT    3600        /* seconds between checks of the cache file */
+#define CACHESCAN       64          /* entries cacheRefresh() looks at each time */
+
+#ifndef CACHEFILE
+#define CACHEFILE       "/var/log/hitta.cache"
+#endif
+
+extern void logMsg();
+extern char *strdate();
+
+extern int cachemax, cachebytes, cachettl, cacheunknown, cacheerror, cachewarm;
+extern int cachehot, cacheahead;
+extern char *cachefile;
+extern unsigned long cachehits, cachemisses;
+
+extern int  cacheInit(void);
+extern void cacheCleanup(void);
+extern int  cacheFind(char *nmbr, char *name);
+extern void cacheStore(char *nmbr, char *name, int class, time_t fetched);
+extern int  cacheWarm(char *logfile, void (*tidy)(char *nmbr),
+                       int (*class)(char *nmbr, char *name));
+extern int  cacheWarmStep(void);
+extern int  cacheRefresh(char *nmbr);
+extern void cacheRefreshed(char *nmbr);
+extern void cacheCompact(void);
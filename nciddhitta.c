@@ -1,280 +1,1866 @@
-/***************************************************************************
-*                                  _   _ ____  _
-*  Project                     ___| | | |  _ \| |
-*                             / __| | | | |_) | |
-*                            | (__| |_| |  _ <| |___
-*                             \___|\___/|_| \_\_____|
-*
-* Copyright (C) 1998 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
-*
-* This software is licensed as described in the file COPYING, which
-* you should have received as part of this distribution. The terms
-* are also available at https://curl.haxx.se/docs/copyright.html.
-*
-* You may opt to use, copy, modify, merge, publish, distribute and/or sell
-* copies of the Software, and permit persons to whom the Software is
-* furnished to do so, under the terms of the COPYING file.
-*
-* This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
-* KIND, either express or implied.
-*
-***************************************************************************/
-/* <DESC>
-* Find name from number in hitta.se
-
-* curl and a write callback function is used to download the hitta.se html  
-* document (page) into memory.
-* 
-* The libxml2 html-parser is used get the html document in memory into 
-* a created DOM tree and from there is retrieved sets of nodes that matches 
-* specified criteria defined as XPath expressions.
-* </DESC>
-*/
-
-#include "ncidd.h"
-#include <ctype.h>
-#include <curl/curl.h>
-
-#include <libxml/tree.h>
-#include <libxml/HTMLparser.h>
-#include <libxml/xpath.h>
-
-#define HITTA_URL "http://www.hitta.se/vem-ringde/%s"
-#define HEADER_ACCEPT "Accept:text/html,application/xhtml+xml,application/xml"
-#define HEADER_USER_AGENT "User-Agent:Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.17 (KHTML, like Gecko) Chrome/24.0.1312.70 Safari/537.17"
-
-#define HITTA_XPATH_01 "//*[@id=\"item-details\"]/div[2]/div[1]/span/h1/span[1]"     //Person - Singel
-#define HITTA_XPATH_02 "//*[@id=\"people\"]/ol/li[1]/div[1]/div[1]/h2/a/span"        //Person - Multi-- + MFL
-#define HITTA_XPATH_03 "//*[@id=\"item-details\"]/div[2]/div[1]/h1/span[1]"          //Företag - Singel
-#define HITTA_XPATH_04 "//*[@id=\"companies\"]/ol/li[1]/div/div/div[1]/h2/a/span"    //Företag - Multi- + MFL
-#define HITTA_XPATH_05 "//*[@id=\"primary-content\"]/h1/span[2]/span"                //Okänt nummer
-#define HITTA_MAX    5
-#define HITTA_MULTI  " - med flera"
-#define HITTA_INTER  "Okänt-Internationellt"
-#define HITTA_SECUR  "Spärrat nummer"
-#define HITTA_SHORT  "För kort nummer"
-#define HITTA_ERROR  "FEL från hitta.se"
-
-#define NATIONAL_PREFX '0'
-#define SWE_DEST_CODES \
-"-10-11-120-121-122-123-125-13-140-141-142-143-144-150-151-152-155-156-157-158-159-16-\
- 171-173-174-175-176-18-19-20-21-200-220-221-222-223-224-225-226-227-23-240-241-243-246-247-248-\
- 250-251-253-258-26-270-271-278-280-281-290-291-292-293-294-295-297-300-301-302-303-304-31-\
- 320-321-322-325-33-340-345-346-35-36-370-371-372-378-380-381-382-383-390-392-393-40-\
- 410-411-413-414-415-416-417-418-42-430-431-433-435-44-451-454-455-456-457-459-46-\
- 470-471-472-474-476-477-478-479-480-481-485-486-490-491-492-493-494-495-496-498-499-\
- 500-501-502-503-504-505-506-510-511-512-513-514-515-520-521-522-523-524-525-526-528-\
- 530-531-532-533-534-54-550-551-552-553-554-555-560-563-564-565-570-571-573-\
- 580-581-582-583-584-585-586-587-589-590-591-60-611-612-613-620-621-622-623-624-63-\
- 640-642-643-644-645-647-650-651-652-653-657-660-661-662-663-670-671-672-680-682-684-687-\
- 690-691-692-693-695-696-70-71-72-73-74-75-76-77-78-8-800-90-900-910-911-912-913-914-915-916-918-\
- 920-921-922-923-924-925-926-927-928-929-930-932-933-934-935-939-940-941-942-943-944-\
- 950-951-952-953-954-960-961-969-970-971-973-975-976-977-978-980-981-99-"
-
-xmlXPathObjectPtr getNodeSet();
-void hittaAlias();
-struct responseStruct {
-  char *html;
-  size_t size;
-};
-static size_t writeMemoryCallback(void *contents, size_t size, size_t nmemb, void *stream) {
-  size_t realsize = size * nmemb;
-  struct responseStruct *mem = (struct responseStruct *)stream;
-
-  mem->html = realloc(mem->html, mem->size + realsize + 1);
-  if(mem->html == NULL) {
-    /* out of memory! */
-    // printf("not enough memory (realloc returned NULL)\n");
-    return 0;
-  }
-
-  memcpy(&(mem->html[mem->size]), contents, realsize);
-  mem->size += realsize;
-  mem->html[mem->size] = 0;
-
-  return realsize;
-}
-xmlXPathObjectPtr getNodeSet (xmlDocPtr doc, xmlChar *xpath, char *name) {	
-	xmlXPathContextPtr context;
-	xmlXPathObjectPtr  result;
-
-	context = xmlXPathNewContext(doc);
-	if (context == NULL) {
-		// printf("Error in xmlXPathNewContext\n");
-    strncpy(name, "Error in xmlXPathNewContext", CIDSIZE - 1);        
-		return NULL;
-	}
-	result = xmlXPathEvalExpression(xpath, context);
-	xmlXPathFreeContext(context);
-	if (result == NULL) {
-		// printf("Error in xmlXPathEvalExpression\n");
-    strncpy(name, "Error in xmlXPathEvalExpression", CIDSIZE - 1);        
-		return NULL;
-	}
-	if(xmlXPathNodeSetIsEmpty(result->nodesetval)){
-		xmlXPathFreeObject(result);
-    // printf("No result\n");
-    strncpy(name, "Error xmlXPathNodeSetIsEmpty", CIDSIZE - 1);        
-		return NULL;
-	}
-	return result;
-}
-void hittaAlias(char *name, char *nmbr) {
-  CURL    *curl_handle;
-  CURLcode curl_code;
-
-  int      i;
-  char     url_buffer[80];
-  struct   responseStruct response;
-  struct   curl_slist     *http_headers = NULL;
-
-  xmlChar          *xpath;
-  xmlChar          *nodeval;
-  xmlNodeSetPtr     nodeset;
-  xmlXPathObjectPtr result;    
-
-  const char *hittaXpath[HITTA_MAX] = {HITTA_XPATH_01, HITTA_XPATH_02, HITTA_XPATH_03, HITTA_XPATH_04, HITTA_XPATH_05};
-  const char *sweDestCodes = SWE_DEST_CODES;
-  
-  char new_nmbr[CIDSIZE];
-  
-  /* Remove all non numeric characters from number */
-  char  c;
-  char *nmbr_old_ptr = nmbr;
-  char *nmbr_new_ptr = nmbr;
-
-  while ((c = *nmbr_old_ptr++))
-      if (isdigit(c))
-          *nmbr_new_ptr++ = c;
-
-  *nmbr_new_ptr = 0; 
-
-  /* Check special & to short numbers */
-  if (strcmp(nmbr, "00") == 0) {
-    strncpy(name, HITTA_INTER, CIDSIZE - 1);
-  }
-  else if (strcmp(nmbr, "10") == 0) {
-    strncpy(name, HITTA_SECUR, CIDSIZE - 1);        
-  }
-  else if (strlen(nmbr) < 3) {
-    strncpy(name, HITTA_SHORT, CIDSIZE - 1);        
-  }
-  else {
-    /* Split number: insert '-' between Dest.Code & Subscriber number */
-    if (nmbr[0] == NATIONAL_PREFX) {
-      for (i = 3; i > 0; i--){
-        strcpy(new_nmbr, "-");
-        if (strlen(nmbr) <= i) continue;
-        strncat(new_nmbr, nmbr + 1, i);
-        strncat(new_nmbr, "-", 1);
-        if (strstr(sweDestCodes, new_nmbr)) {
-          new_nmbr[0] = '0';
-          if (strlen(new_nmbr) == 4 && strlen(nmbr) > 8 && nmbr[1] == '7' 
-          && (nmbr[4] != '0' || (nmbr[3] == '0' && nmbr[4] == '0'))){
-            memcpy(&new_nmbr[3], &nmbr[3], 1);
-            strncat(new_nmbr, "-", 1);
-            i++;;
-          }
-          strcat(new_nmbr, nmbr + i + 1);
-          strcpy(nmbr, new_nmbr);
-          break;
-        }
-      }
-    }
-    
-    /* create url */    
-    sprintf(url_buffer, HITTA_URL, nmbr);
-
-    /* allocate memory */    
-    response.html = malloc(1);  /* will be grown as needed by the realloc above */
-    response.size = 0;          /* no data at this point */
-
-    curl_global_init(CURL_GLOBAL_ALL);
-
-    /* init the curl session */
-    curl_handle = curl_easy_init();
-
-    /* check if a handle was received */    
-    if (curl_handle) {
-      /* set URL to get here */
-      curl_easy_setopt(curl_handle, CURLOPT_URL, url_buffer);
-
-      /* provide a user-agent field*/
-      curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, HEADER_USER_AGENT);
-
-      /* modify a header curl otherwise adds differently */
-      http_headers = curl_slist_append(http_headers, HEADER_ACCEPT);
-      
-      /* set our custom set of headers */
-      curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, http_headers);
-     
-      /* tell libcurl to follow redirection */
-      curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1L);
-
-      /* disable progress meter, set to 0L to enable and disable debug output */
-      curl_easy_setopt(curl_handle, CURLOPT_NOPROGRESS, 1L);
-
-      /* send all data to this function  */
-      curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, writeMemoryCallback);
-
-      /* pass the 'response' struct to the callback function */
-      curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&response);
-
-      /* get it! */
-      curl_code = curl_easy_perform(curl_handle);
-
-      /* free the custom headers */
-      curl_slist_free_all(http_headers);
-
-      /* cleanup curl stuff */
-      curl_easy_cleanup(curl_handle);
-
-      /* we're done with libcurl, so clean it up */
-      curl_global_cleanup();
-
-      /* check for curl errors */
-      if(curl_code == CURLE_OK) {
-        /* parse the html response document in memory and create a DOM tree */
-        xmlDocPtr doc = htmlReadDoc((xmlChar*)response.html, NULL, NULL, HTML_PARSE_RECOVER | HTML_PARSE_NOERROR | HTML_PARSE_NOWARNING);
-
-         /* free allocated response memory */
-        free(response.html);
-        
-        /* check for parse errors */
-        if (doc) {
-          /* look for found names */
-          for (i=1; i <= HITTA_MAX; i++) {
-            xpath = (xmlChar*) hittaXpath[i-1];
-            result = getNodeSet(doc, xpath, name);
-            if (result) { 
-              nodeset = result->nodesetval;
-              nodeval = xmlNodeListGetString(doc, nodeset->nodeTab[0]->xmlChildrenNode, 1);
-              xmlXPathFreeObject(result);
-              
-              if (nodeval) {
-                strncpy(name, nodeval, CIDSIZE - 1);
-                if (i==2 || i==4) strncat(name, HITTA_MULTI, CIDSIZE - strlen(name) - 1 );
-                xmlFree(nodeval);
-                break;
-              }
-              else {
-                strncpy(name, "Error in xmlNodeListGetString->nodeval", CIDSIZE - 1);        
-              }
-            }
-          }
-        }
-        else {
-          strncpy(name, "Error in htmlReadDoc->No doc", CIDSIZE - 1);        
-        }
-        xmlFreeDoc(doc);
-      }
-      else {
-        strncpy(name, "Error in curl->Not CURL_OK", CIDSIZE - 1);        
-      }
-    }
-    else {
-      strncpy(name, "Error in curl->No curl_handle", CIDSIZE - 1);        
-    }
-    xmlCleanupParser();
-  }    
-}
\ No newline at end of file
+/***************************************************************************
+*                                  _   _ ____  _
+*  Project                     ___| | | |  _ \| |
+*                             / __| | | | |_) | |
+*                            | (__| |_| |  _ <| |___
+*                             \___|\___/|_| \_\_____|
+*
+* Copyright (C) 1998 - 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
+*
+* This software is licensed as described in the file COPYING, which
+* you should have received as part of this distribution. The terms
+* are also available at https://curl.haxx.se/docs/copyright.html.
+*
+* You may opt to use, copy, modify, merge, publish, distribute and/or sell
+* copies of the Software, and permit persons to whom the Software is
+* furnished to do so, under the terms of the COPYING file.
+*
+* This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+* KIND, either express or implied.
+*
+***************************************************************************/
+/* <DESC>
+* Find name from number in hitta.se
+
+* curl and a write callback function is used to download the hitta.se html  
+* document (page) and feed it to the libxml2 html push parser as it comes,
+* the transfer is stopped as soon as the name is in the parsed part.
+* The page is asked for compressed, with every encoding curl was built
+* with, and curl decodes each part before it reaches the parser.
+*
+* The downloads are done with the curl multi interface. The curl sockets
+* and timer are registered in the ncidd polld[] table so a lookup never
+* blocks the main poll() loop, the caller is told by a callback when the
+* name is ready.
+*
+* The curl handles, the header list and the DNS and TLS session caches
+* are made once by hittaInit() and kept until hittaCleanup(), so a
+* lookup can reuse the connection to hitta.se the last lookup left open.
+* 
+* The name providers are asked in the order of the chain, hitta.se by
+* default.  Another provider is an url and XPath expressions for its
+* page, set with --hitta provider= and xpath=.  After an error the next
+* provider is asked, and when hedging it is also asked if the one before
+* is slower than usual; the first answer is taken and the rest stopped.
+* 
+* A number in the local phonebook, see nciddbook.c, is named from it
+* first, without a lookup, when "phonebook" is in the chain.
+* 
+* A lookup is started once per number, a call for a number that is
+* already being looked up waits for the same answer.
+* 
+* Requests to the providers are paced by a token bucket of hittarate
+* a minute and hittaburst at once.  A call's lookup may use all of it
+* and waits in a short queue when it is empty, background lookups only
+* use what is left above hittareserve and are refused otherwise; a
+* refused lookup keeps the name it came with, as the cache has none.
+* 
+* While ncidd is idle, hittaRefresh() looks up again a few numbers
+* called often whose cached names are close to expiring, as background
+* lookups, so their next call finds a fresh name in the cache.
+* 
+* With hittahelpers set, the lookups run in that many helper processes
+* forked at start, so libcurl and libxml2 and what they keep or leak
+* stay out of ncidd, and lookups use more than one core.  ncidd keeps
+* the phonebook, the cache, the rate limit and the callers, and sends
+* each number to the least busy helper over a socketpair in polld[]:
+* a frame is its length (4) and then, to the helper, id (4) and the
+* number, and back, id (4) class (1) RSS KB (4) and the name.  A helper
+* is replaced after hittarecycle requests, when it uses more than
+* hittahelpermem KB, when it exits, or when it does not answer.  The
+* circuit breakers, the hedge delays and the phase times are then each
+* helper's own, lost when it is replaced, and hittaStats() in ncidd
+* only has the cache, the rate limit and the helpers, so the helpers
+* are off unless hittahelpers is set.
+* 
+* A circuit breaker stops the requests to a provider for a while when it
+* keeps failing or is slow, the calls then keep the name they came with.
+* 
+* The libxml2 html-parser is used get the html document into 
+* a created DOM tree and from there is retrieved sets of nodes that matches 
+* specified criteria defined as XPath expressions.
+*
+* Each request records how long DNS, connect, TLS, the first byte, the
+* whole transfer, the html parsing and the XPath walks took, from curl
+* and the monotonic clock, in a histogram per phase.  hittaStats() logs
+* them, ncidd calls it on SIGUSR2.
+* 
+* With hittaarena set, the libxml2 blocks of each request come from an
+* arena of its own, see nciddarena.c, freed in one go when it ends.
+* 
+* The XPath expressions of a provider are compiled by hittaInit() into
+* one union, so a single walk of the document finds the nodes of all of them.  Which
+* expression a node matched is told by how far up the tree its id is.
+* </DESC>
+*/
+
+#include "ncidd.h"
+#include "nciddhitta.h"
+#include "nciddcache.h"
+#include "nciddbook.h"
+#include "nciddarena.h"
+#include "nciddpoll.h"
+#include <ctype.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <curl/curl.h>
+
+#include <libxml/tree.h>
+#include <libxml/HTMLparser.h>
+#include <libxml/SAX2.h>
+#include <libxml/xpath.h>
+
+#define HITTA_URL "http://www.hitta.se/vem-ringde/%s"
+#define HEADER_ACCEPT "Accept:text/html,application/xhtml+xml,application/xml"
+#define HEADER_USER_AGENT "User-Agent:Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.17 (KHTML, like Gecko) Chrome/24.0.1312.70 Safari/537.17"
+
+#define HITTA_XPATH_01 "//*[@id=\"item-details\"]/div[2]/div[1]/span/h1/span[1]"     //Person - Singel
+#define HITTA_XPATH_02 "//*[@id=\"people\"]/ol/li[1]/div[1]/div[1]/h2/a/span"        //Person - Multi-- + MFL
+#define HITTA_XPATH_03 "//*[@id=\"item-details\"]/div[2]/div[1]/h1/span[1]"          //Företag - Singel
+#define HITTA_XPATH_04 "//*[@id=\"companies\"]/ol/li[1]/div/div/div[1]/h2/a/span"    //Företag - Multi- + MFL
+#define HITTA_XPATH_05 "//*[@id=\"primary-content\"]/h1/span[2]/span"                //Okänt nummer
+#define HITTA_UNKNOWN "Okänt nummer" /* what HITTA_XPATH_05 finds */
+#define HITTA_MAX    8      /* XPath expressions of a provider */
+#define HITTA_MULTI  " - med flera"
+#define HITTA_INTER  "Okänt-Internationellt"
+#define HITTA_SECUR  "Spärrat nummer"
+#define HITTA_SHORT  "För kort nummer"
+#define HITTA_ERROR  "FEL från hitta.se"
+#define HITTA_TIMEOUT 10L   /* seconds, maximum time for one lookup */
+#define HITTA_DNSTTL  600L  /* seconds a resolved hitta.se address is kept */
+#define HITTA_IDLE    4     /* curl handles kept for the next lookups */
+#define HITTA_DRAIN   16384 /* bytes read after the name to keep the connection */
+#define HITTA_BACKOFF 5L    /* seconds the breaker is first open */
+#define HITTA_BACKMAX 300L  /* seconds the breaker is open at most */
+#define HITTA_PROVIDERS 4   /* hitta.se and the ones from --hitta provider= */
+#define HITTA_URLSIZE 256   /* bytes of a provider url with the number */
+#define HITTA_SAMPLES 32    /* answer times kept for the hedge delay */
+#define HITTA_HEDGE   1000L /* ms hedge delay until there are enough samples */
+#define HITTA_HEDGEMIN 50L  /* ms, the shortest hedge delay */
+#define HITTA_BUCKETS 25    /* histogram buckets, 2^i to 2^(i+1) us */
+#define HITTA_QUEUE   16    /* calls' lookups waiting for the rate limit */
+#define HITTA_HELPERS 8     /* helper processes at most */
+#define HITTA_FRAME   128   /* bytes of a helper frame at most, with its length */
+#define HITTA_HUNG    2000L /* ms over HITTA_TIMEOUT before a helper is hung */
+
+/* kind of name a provider's XPath expression finds */
+#define RULE_NAME     0     /* the name */
+#define RULE_MULTI    1     /* the first of many names, HITTA_MULTI is added */
+#define RULE_UNKNOWN  2     /* the provider does not know the number */
+
+/* phases of a request, timed into a histogram each */
+enum hittaPhase {PHASE_DNS, PHASE_CONNECT, PHASE_TLS, PHASE_TTFB, PHASE_TOTAL,
+                 PHASE_PARSE, PHASE_XPATH, PHASE_MAX};
+static const char *phaseName[PHASE_MAX] = {"dns", "connect", "tls", "ttfb",
+                                           "total", "parse", "xpath"};
+
+static struct hittaHisto {
+  unsigned long count;
+  unsigned long bucket[HITTA_BUCKETS];
+  double   sum;                        /* us */
+  curl_off_t max;                      /* us */
+} histo[PHASE_MAX];
+
+/* a caller waiting for a lookup */
+struct hittaWaiter {
+  void   (*done)(char *name, void *arg);
+  void    *arg;
+  char     prev[CIDSIZE];              /* name before the lookup */
+  struct hittaWaiter *next;
+};
+
+/* circuit breaker, open stops the lookups, probe lets one through */
+enum hittaBreaker {BREAKER_CLOSED, BREAKER_OPEN, BREAKER_PROBE};
+
+/* a name provider, one html page per number searched with XPath */
+struct hittaProvider {
+  char        name[16];
+  const char *url;                     /* %s is the number */
+  int         count;                   /* XPath expressions */
+  struct hittaRule {
+    const char *xpath;
+    int   kind;                        /* RULE_x */
+    char  id[32];                      /* id of the element the path is from */
+    int   depth;                       /* steps below it */
+  } rule[HITTA_MAX];                   /* the first that has a name is used */
+  xmlXPathCompExprPtr xpath_all;       /* the expressions in one union */
+  long    latency[HITTA_SAMPLES];      /* ms of the last answers, a ring */
+  int     samples;                     /* answers since the start */
+  enum hittaBreaker breaker;
+  int     failures;                    /* in a row */
+  long    backoff;                     /* seconds open, doubled for each failed probe */
+  long    breaker_until;               /* hittaNow() when open ends */
+};
+
+/* one provider asked for a name */
+struct hittaRequest {
+  struct hittaLookup   *lookup;
+  struct hittaProvider *prov;
+  CURL    *curl_handle;
+  htmlParserCtxtPtr parser;
+  size_t   bytes;                      /* of the page read so far, decoded */
+  int      anchor;                     /* an id of prov->rule[] was parsed */
+  int      class;                      /* result class, -1 until known */
+  long     started;                    /* hittaNow() at the start */
+  curl_off_t parse_us, xpath_us;       /* spent in libxml2 */
+  struct arena *arena;                 /* of its libxml2 blocks, NULL if none */
+  char     url_buffer[HITTA_URLSIZE];
+  char     name[CIDSIZE];
+};
+
+/* one number being looked up, by one or more providers */
+struct hittaLookup {
+  char     nmbr[CIDSIZE];
+  char     name[CIDSIZE];
+  struct hittaRequest *request[HITTA_PROVIDERS];  /* running */
+  int      asked;                      /* providers of chain[] tried */
+  long     hedge;                      /* hittaNow() when the next is asked too, 0 if not */
+  int      priority;                   /* HITTA_LIVE or HITTA_BACKGROUND */
+  long     queued;                     /* hittaNow() when it began to wait for a token, 0 if not */
+  int      helper;                     /* 1 + helper[] it was sent to, 0 if none */
+  uint32_t id;                         /* of the frame sent to the helper */
+  long     sent;                       /* hittaNow() when it was sent */
+  struct hittaWaiter *waiters;         /* in the order they came */
+  struct hittaLookup *next;            /* on the inflight list */
+};
+
+int hittawait = HITTAWAIT;
+int hittatrip = HITTATRIP;
+int hittaslow = HITTASLOW;
+int hittahedge = HITTAHEDGE;
+char *hittachain = HITTACHAIN;
+int hittarate = HITTARATE;
+int hittaburst = HITTABURST;
+int hittareserve = HITTARESERVE;
+int hittarefresh = HITTAREFRESH;
+int hittahelpers = HITTAHELPERS;
+int hittarecycle = HITTARECYCLE;
+int hittahelpermem = HITTAHELPERMEM;
+int hittaarena = HITTAARENA;
+int (*hittawarmname)(char *nmbr, char *name);
+
+static CURLM *multi_handle;
+static long   multi_timeout = -1;      /* curl timer in ms, -1 if not set */
+static long   multi_deadline;          /* hittaNow() when the timer expires */
+static char  *lookupPoll;              /* polld[pos] is a lookup socket */
+static struct hittaLookup *inflight;   /* lookups started, by number */
+
+static CURLSH *share_handle;           /* DNS and TLS session cache */
+static struct curl_slist *http_headers;
+static CURL  *idleHandle[HITTA_IDLE];  /* set up and ready for a lookup */
+static int    idleCount;
+
+/* hitta.se, and the providers from --hitta provider= */
+static struct hittaProvider provider[HITTA_PROVIDERS] = {
+  {"hitta", HITTA_URL, 5, {
+    {HITTA_XPATH_01, RULE_NAME},
+    {HITTA_XPATH_02, RULE_MULTI},
+    {HITTA_XPATH_03, RULE_NAME},
+    {HITTA_XPATH_04, RULE_MULTI},
+    {HITTA_XPATH_05, RULE_UNKNOWN}}}
+};
+static int providers = 1;
+
+/* from hittachain, the providers in the order they are asked */
+static struct hittaProvider *chain[HITTA_PROVIDERS];
+static int  chainlen;
+static int  usecache;                  /* "cache" is in the chain */
+static int  usebook;                   /* "phonebook" is in the chain */
+static int  warming;                   /* cidcall.log is read into the cache */
+
+/* the rate limit, a token is a request to a provider */
+static double tokens = -1;             /* -1 until the bucket is filled */
+static long   refilled;                /* hittaNow() of the last refill */
+static int    queuelen;                /* lookups with queued set */
+static unsigned long ratequeued, raterefused;
+
+/* a lookup helper process, and ncidd's end of its socketpair */
+static struct hittaHelper {
+  pid_t    pid;                        /* 0 if not running */
+  int      fd, pos;                    /* pos in polld[] */
+  unsigned long served;                /* numbers sent to it */
+  int      busy;                       /* numbers not answered yet */
+  int      draining;                   /* no more numbers, replaced when idle */
+  size_t   inlen;
+  unsigned char in[HITTA_FRAME * 4];   /* frames read, not complete */
+} helper[HITTA_HELPERS];
+static char    *helperPoll;              /* 1 + helper[] of polld[pos] */
+static uint32_t helperid;               /* id of the last frame sent */
+static int      helperfd;               /* in a helper, its end of the socketpair */
+static int      endclass;               /* class of the lookup ending, for a helper */
+
+/* page bytes of all requests, as sent by the providers and decoded */
+static double wirebytes, pagebytes;
+
+static xmlXPathContextPtr  xpath_context;  /* doc is set for each lookup */
+static htmlSAXHandler hittaSAX;            /* builds the tree, finds anchors */
+
+static char destCode[4][1000];             /* from SWE_DEST_CODES */
+static int  destInit;
+
+static int setProvider(char *value), setXpath(char *value), setUrl(char *value);
+static int helperRequest(struct hittaLookup *lookup);
+static int warmClass(char *nmbr, char *name);
+
+/* settings changed with --hitta word=value */
+static struct hittaword {
+  char  *word;
+  int   *value;
+  int    min, max;
+  char **string;                       /* instead of value, if set */
+  int  (*set)(char *value);            /* instead of value, if set */
+} hittaword[] = {
+  {"cachemax",     &cachemax,     0, 1000000, 0,           0},
+  {"cachebytes",   &cachebytes,   0, 1 << 30, 0,           0},
+  {"cachettl",     &cachettl,     0, 1 << 30, 0,           0},
+  {"cacheunknown", &cacheunknown, 0, 1 << 30, 0,           0},
+  {"cacheerror",   &cacheerror,   0, 1 << 30, 0,           0},
+  {"cachewarm",    &cachewarm,    0, 1,       0,           0},
+  {"cachehot",     &cachehot,     1, 1 << 30, 0,           0},
+  {"cacheahead",   &cacheahead,   0, 100,     0,           0},
+  {"wait",         &hittawait,    0, 60000,   0,           0},
+  {"trip",         &hittatrip,    0, 1000,    0,           0},
+  {"slow",         &hittaslow,    0, 60000,   0,           0},
+  {"hedge",        &hittahedge,   0, 99,      0,           0},
+  {"rate",         &hittarate,    0, 60000,   0,           0},
+  {"burst",        &hittaburst,   1, 1000,    0,           0},
+  {"reserve",      &hittareserve, 0, 1000,    0,           0},
+  {"refresh",      &hittarefresh, 0, 100,     0,           0},
+  {"helpers",      &hittahelpers, 0, HITTA_HELPERS, 0,     0},
+  {"recycle",      &hittarecycle, 0, 1 << 30, 0,           0},
+  {"helpermem",    &hittahelpermem, 0, 1 << 30, 0,         0},
+  {"arena",        &hittaarena,   0, 1,       0,           0},
+  {"cachefile",    0,             0, 0,       &cachefile,  0},
+  {"phonebook",    0,             0, 0,       &bookfile,   0},
+  {"chain",        0,             0, 0,       &hittachain, 0},
+  {"provider",     0,             0, 0,       0,           setProvider},
+  {"xpath",        0,             0, 0,       0,           setXpath},
+  {"url",          0,             0, 0,       0,           setUrl},
+  {0, 0, 0, 0, 0, 0}
+};
+
+/* monotonic clock in milliseconds */
+long hittaNow(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+/* monotonic clock in microseconds, for the phases */
+static curl_off_t hittaMicro(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (curl_off_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+/* add the time of one phase to its histogram */
+static void phaseAdd(enum hittaPhase phase, curl_off_t us) {
+  struct hittaHisto *hp = &histo[phase];
+  int i;
+
+  if (us < 0) return;
+  for (i = 0; i < HITTA_BUCKETS - 1 && us >= ((curl_off_t) 2 << i); i++);
+  hp->bucket[i]++;
+  hp->count++;
+  hp->sum += us;
+  if (us > hp->max) hp->max = us;
+}
+/* us below which pct percent of a phase are, the top of the bucket */
+static double phasePct(struct hittaHisto *hp, int pct) {
+  unsigned long seen = 0, need = (hp->count * pct + 99) / 100;
+  int i;
+
+  for (i = 0; i < HITTA_BUCKETS - 1; i++)
+    if ((seen += hp->bucket[i]) >= need) break;
+  if (i == HITTA_BUCKETS - 1 || ((curl_off_t) 2 << i) > hp->max)
+    return (double) hp->max;
+  return (double) ((curl_off_t) 2 << i);
+}
+/*
+ * the phases of a finished request, from curl and from the time spent
+ * in libxml2, DNS and connect only count when a connection was made
+ */
+static void phaseRecord(struct hittaRequest *req) {
+  curl_off_t dns = 0, connect = 0, tls = 0, ttfb = 0, total = 0, wire = 0;
+  char msgbuf[BUFSIZ];
+
+  curl_easy_getinfo(req->curl_handle, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+  curl_easy_getinfo(req->curl_handle, CURLINFO_CONNECT_TIME_T, &connect);
+  curl_easy_getinfo(req->curl_handle, CURLINFO_APPCONNECT_TIME_T, &tls);
+  curl_easy_getinfo(req->curl_handle, CURLINFO_STARTTRANSFER_TIME_T, &ttfb);
+  curl_easy_getinfo(req->curl_handle, CURLINFO_TOTAL_TIME_T, &total);
+  curl_easy_getinfo(req->curl_handle, CURLINFO_SIZE_DOWNLOAD_T, &wire);
+
+  /* the times from curl are from the start, each phase is the difference */
+  if (connect) {
+    phaseAdd(PHASE_DNS, dns);
+    phaseAdd(PHASE_CONNECT, connect - dns);
+  }
+  if (tls) phaseAdd(PHASE_TLS, tls - connect);
+  if (ttfb) phaseAdd(PHASE_TTFB, ttfb);
+  phaseAdd(PHASE_TOTAL, total);
+  phaseAdd(PHASE_PARSE, req->parse_us);
+  phaseAdd(PHASE_XPATH, req->xpath_us);
+  wirebytes += wire;
+  pagebytes += req->bytes;
+
+  sprintf(msgbuf, "%s times ms: dns %.1f connect %.1f tls %.1f ttfb %.1f"
+    " total %.1f parse %.1f xpath %.1f, bytes %ld sent %lu decoded\n",
+    req->prov->name, dns / 1000.0, (connect ? connect - dns : 0) / 1000.0,
+    (tls ? tls - connect : 0) / 1000.0, ttfb / 1000.0, total / 1000.0,
+    req->parse_us / 1000.0, req->xpath_us / 1000.0, (long) wire,
+    (unsigned long) req->bytes);
+  logMsg(LEVEL4, msgbuf);
+}
+/* log the histogram of each phase, in ms */
+void hittaStats(void) {
+  struct hittaHisto *hp;
+  char msgbuf[BUFSIZ];
+  int i;
+
+  for (i = 0; i < PHASE_MAX; i++) {
+    hp = &histo[i];
+    if (!hp->count) continue;
+    sprintf(msgbuf, "hitta.se %-7s %6lu times, ms mean %.1f p50 %.1f p90 %.1f"
+      " p99 %.1f max %.1f\n", phaseName[i], hp->count,
+      hp->sum / hp->count / 1000.0, phasePct(hp, 50) / 1000.0,
+      phasePct(hp, 90) / 1000.0, phasePct(hp, 99) / 1000.0, hp->max / 1000.0);
+    logMsg(LEVEL1, msgbuf);
+  }
+  if (histo[PHASE_TOTAL].count) {
+    sprintf(msgbuf, "hitta.se bytes per request %.0f sent, %.0f decoded\n",
+      wirebytes / histo[PHASE_TOTAL].count, pagebytes / histo[PHASE_TOTAL].count);
+    logMsg(LEVEL1, msgbuf);
+  }
+  for (i = 0; i < hittahelpers; i++) {
+    if (!helper[i].pid) continue;
+    sprintf(msgbuf, "hitta.se helper %d pid %d, %lu numbers, %d running%s\n", i,
+      (int) helper[i].pid, helper[i].served, helper[i].busy,
+      helper[i].draining ? ", to be replaced" : "");
+    logMsg(LEVEL1, msgbuf);
+  }
+  if (hittaarena) {
+    sprintf(msgbuf, "hitta.se arena %lu chunks, %lu kept after their request\n",
+      arenachunks, arenaorphans);
+    logMsg(LEVEL1, msgbuf);
+  }
+  if (hittarate) {
+    sprintf(msgbuf, "hitta.se rate limit %d/min, %.1f tokens, %d waiting,"
+      " %lu waited, %lu refused\n", hittarate, tokens < 0 ? (double) hittaburst : tokens,
+      queuelen, ratequeued, raterefused);
+    logMsg(LEVEL1, msgbuf);
+  }
+}
+/* the provider with a name of len characters, or NULL */
+static struct hittaProvider *findProvider(const char *name, size_t len) {
+  int i;
+
+  for (i = 0; i < providers; i++)
+    if (strlen(provider[i].name) == len && !strncmp(provider[i].name, name, len))
+      return &provider[i];
+  return NULL;
+}
+/* which rule, from 1, a node of prov->xpath_all is from */
+static int getRule(struct hittaProvider *prov, xmlNodePtr node) {
+  xmlChar *id;
+  int depth, i, rule = 0;
+
+  for (depth = 0; node && node->type == XML_ELEMENT_NODE && !rule; ++depth) {
+    if ((id = xmlGetProp(node, (xmlChar *) "id"))) {
+      for (i = 0; i < prov->count; i++) {
+        if (prov->rule[i].depth == depth && !strcmp((char *) id, prov->rule[i].id)) {
+          rule = i + 1;
+          break;
+        }
+      }
+      xmlFree(id);
+    }
+    node = node->parent;
+  }
+  return rule;
+}
+/*
+ * look for the name in the page parsed so far, a node is only used when
+ * the parser is past its end, all are at the end of the page
+ * returns the result class, or -1 if the name is not found yet
+ */
+static int hittaMatch(struct hittaRequest *req, int final) {
+  int      i, rule, best = HITTA_MAX + 1, class = -1;
+  char    *name = req->name;
+  xmlChar          *nodeval, *bestval = NULL;
+  xmlNodeSetPtr     nodeset;
+  xmlNodePtr        node, open;
+  xmlXPathObjectPtr result;    
+  xmlDocPtr doc = req->parser->myDoc;
+  struct hittaProvider *prov = req->prov;
+  curl_off_t        us = hittaMicro();
+
+  /* check for parse errors */
+  if (!doc) {
+    if (!final) return class;
+    strncpy(name, "Error in htmlParseChunk->No doc", CIDSIZE - 1);        
+    return CACHE_ERROR;
+  }
+
+  /* one walk for all expressions, the nodes come in document order */
+  xpath_context->doc = doc;
+  xpath_context->node = (xmlNodePtr) doc;
+  result = xmlXPathCompiledEval(prov->xpath_all, xpath_context);
+  if (result && !xmlXPathNodeSetIsEmpty(result->nodesetval)) {
+    /* the first node with a name of the first expression that has one */
+    nodeset = result->nodesetval;
+    for (i = 0; i < nodeset->nodeNr; i++) {
+      node = nodeset->nodeTab[i];
+      for (open = final ? NULL : req->parser->node; open && open != node; open = open->parent);
+      if (open) continue;
+      rule = getRule(prov, node);
+      if (!rule || rule >= best) continue;
+      nodeval = xmlNodeListGetString(doc, node->xmlChildrenNode, 1);
+      if (!nodeval) continue;
+      if (bestval) xmlFree(bestval);
+      bestval = nodeval;
+      best = rule;
+    }
+  }
+  if (bestval) {
+    strncpy(name, (char *) bestval, CIDSIZE - 1);
+    if (prov->rule[best - 1].kind == RULE_MULTI)
+      strncat(name, HITTA_MULTI, CIDSIZE - strlen(name) - 1 );
+    class = (prov->rule[best - 1].kind == RULE_UNKNOWN) ? CACHE_UNKNOWN : CACHE_NAME;
+    xmlFree(bestval);
+  }
+  else if (final) {
+    class = CACHE_ERROR;
+    if (result == NULL)
+      strncpy(name, "Error in xmlXPathCompiledEval", CIDSIZE - 1);        
+    else if (xmlXPathNodeSetIsEmpty(result->nodesetval))
+      strncpy(name, "Error xmlXPathNodeSetIsEmpty", CIDSIZE - 1);        
+    else
+      strncpy(name, "Error in xmlNodeListGetString->nodeval", CIDSIZE - 1);        
+  }
+  xmlXPathFreeObject(result);
+  xpath_context->doc = NULL;
+  xpath_context->node = NULL;
+  req->xpath_us += hittaMicro() - us;
+
+  return class;
+}
+/* SAX start of element: build the tree, and note an id a rule is from */
+static void startElement(void *ctx, const xmlChar *tag, const xmlChar **attrs) {
+  htmlParserCtxtPtr parser = (htmlParserCtxtPtr) ctx;
+  struct hittaRequest *req = (struct hittaRequest *) parser->_private;
+  int i;
+
+  xmlSAX2StartElement(ctx, tag, attrs);
+
+  for (; attrs && attrs[0] && !req->anchor; attrs += 2) {
+    if (!attrs[1] || xmlStrcasecmp(attrs[0], (xmlChar *) "id")) continue;
+    for (i = 0; i < req->prov->count; i++)
+      if (!strcmp((char *) attrs[1], req->prov->rule[i].id)) req->anchor = 1;
+  }
+}
+/*
+ * parse the html document as curl downloads it, and look for the name
+ * after each part that has an element it can be below
+ */
+static size_t writeParseCallback(void *contents, size_t size, size_t nmemb, void *stream) {
+  size_t realsize = size * nmemb;
+  struct hittaRequest *req = (struct hittaRequest *)stream;
+  struct arena *saved;
+  curl_off_t length, wire, us;
+
+  req->bytes += realsize;
+
+  /* name found, the rest is only read to keep the connection */
+  if (req->class >= 0) return realsize;
+
+  saved = arenaUse(req->arena);
+  us = hittaMicro();
+  htmlParseChunk(req->parser, (char *) contents, (int) realsize, 0);
+  req->parse_us += hittaMicro() - us;
+  if (req->anchor) req->class = hittaMatch(req, 0);
+  arenaUse(saved);
+  if (req->class < 0) return realsize;
+
+  /* stop a long page, returning less than realsize makes curl abort;
+     both lengths are before decoding, as the page is sent */
+  curl_easy_getinfo(req->curl_handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+  curl_easy_getinfo(req->curl_handle, CURLINFO_SIZE_DOWNLOAD_T, &wire);
+  if (length < 0 || length - wire > HITTA_DRAIN) return 0;
+
+  return realsize;
+}
+static void freeParser(struct hittaRequest *req) {
+  struct arena *saved = arenaUse(req->arena);
+
+  if (req->parser) {
+    if (req->parser->myDoc) xmlFreeDoc(req->parser->myDoc);
+    htmlFreeParserCtxt(req->parser);
+    req->parser = NULL;
+  }
+  arenaUse(saved);
+
+  /* what is left of the request's blocks goes at once */
+  arenaRelease(req->arena);
+  req->arena = NULL;
+}
+/*
+ * the id an XPath expression starts at and the depth below it, for
+ * getRule(), returns -1 if it does not start at an element with an id
+ */
+static int ruleAnchor(struct hittaRule *rule) {
+  const char *ptr, *end;
+
+  if (strncmp(rule->xpath, "//*[@id=\"", 9)) return -1;
+  ptr = rule->xpath + 9;
+  if (!(end = strchr(ptr, '"')) || end - ptr >= (int) sizeof(rule->id)) return -1;
+  memset(rule->id, 0, sizeof(rule->id));
+  strncpy(rule->id, ptr, end - ptr);
+  rule->depth = 0;
+  for (ptr = end; *ptr; ptr++) if (*ptr == '/') rule->depth++;
+
+  return 0;
+}
+/*
+ * compile the XPath expressions of a provider into one union, so a
+ * single walk of the document finds the nodes of all of them
+ */
+static int providerInit(struct hittaProvider *prov) {
+  char  all[BUFSIZ] = "";
+  int   i;
+
+  if (!prov->count) return -1;
+  for (i = 0; i < prov->count; i++) {
+    if (ruleAnchor(&prov->rule[i])) return -1;
+    if (strlen(all) + strlen(prov->rule[i].xpath) + 4 >= sizeof(all)) return -1;
+    if (i) strcat(all, " | ");
+    strcat(all, prov->rule[i].xpath);
+  }
+  if (!(prov->xpath_all = xmlXPathCompile((xmlChar *) all))) return -1;
+
+  return 0;
+}
+/* the providers of hittachain in order, "cache" is the number cache */
+static int chainInit(void) {
+  struct hittaProvider *prov;
+  const char *ptr, *end;
+
+  chainlen = usecache = usebook = 0;
+  for (ptr = hittachain; *ptr; ptr = *end ? end + 1 : end) {
+    end = ptr + strcspn(ptr, ",");
+    if (end - ptr == 5 && !strncmp(ptr, "cache", 5)) usecache = 1;
+    else if (end - ptr == 9 && !strncmp(ptr, "phonebook", 9)) usebook = 1;
+    else if (!(prov = findProvider(ptr, end - ptr)) || chainlen == HITTA_PROVIDERS) return -1;
+    else chain[chainlen++] = prov;
+  }
+
+  return 0;
+}
+/* a provider url must have %s once, for the number */
+static int checkUrl(const char *url) {
+  const char *ptr;
+
+  if (!(ptr = strstr(url, "%s")) || strstr(ptr + 2, "%s")) return -1;
+  if (strlen(url) + CIDSIZE >= HITTA_URLSIZE) return -1;
+
+  return 0;
+}
+/*
+ * --hitta provider=name=url adds a provider, %s in the url is the number,
+ * its XPath expressions are added with --hitta xpath=name=...
+ */
+static int setProvider(char *value) {
+  struct hittaProvider *prov;
+  char *url;
+
+  if (!(url = strchr(value, '=')) || url == value
+      || url - value >= (int) sizeof(prov->name)) return -1;
+  if (findProvider(value, url - value) || providers == HITTA_PROVIDERS) return -1;
+  if (checkUrl(++url)) return -1;
+
+  prov = &provider[providers++];
+  strncpy(prov->name, value, url - value - 1);
+  prov->url = url;
+
+  return 0;
+}
+/* --hitta url=name=url moves a provider, hitta.se too, to another url */
+static int setUrl(char *value) {
+  struct hittaProvider *prov;
+  char *url;
+
+  if (!(url = strchr(value, '=')) || !(prov = findProvider(value, url - value))) return -1;
+  if (checkUrl(++url)) return -1;
+  prov->url = url;
+
+  return 0;
+}
+/*
+ * --hitta xpath=name=kind:expression adds an XPath expression to a
+ * provider, kind is name, multi or unknown, and the expression must
+ * start at an element with an id like HITTA_XPATH_01
+ */
+static int setXpath(char *value) {
+  static const char *kinds[] = {"name:", "multi:", "unknown:", 0};
+  struct hittaProvider *prov;
+  struct hittaRule *rule;
+  char *ptr;
+  int   kind;
+
+  if (!(ptr = strchr(value, '=')) || !(prov = findProvider(value, ptr - value))) return -1;
+  if (prov->count == HITTA_MAX) return -1;
+
+  for (++ptr, kind = 0; kinds[kind]; kind++)
+    if (!strncmp(ptr, kinds[kind], strlen(kinds[kind]))) break;
+  if (!kinds[kind]) return -1;
+
+  rule = &prov->rule[prov->count];
+  rule->xpath = ptr + strlen(kinds[kind]);
+  rule->kind = kind;
+  if (ruleAnchor(rule)) return -1;
+  prov->count++;
+
+  return 0;
+}
+/* a curl handle with all options set, except those for the lookup */
+static CURL *getHandle(void) {
+  CURL *curl_handle;
+
+  if (idleCount) return idleHandle[--idleCount];
+
+  if (!(curl_handle = curl_easy_init())) return NULL;
+
+  /* provide a user-agent field*/
+  curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, HEADER_USER_AGENT);
+
+  /* ask for a compressed page, "" offers all encodings curl can decode */
+  curl_easy_setopt(curl_handle, CURLOPT_ACCEPT_ENCODING, "");
+
+  /* set our custom set of headers */
+  curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, http_headers);
+
+  /* tell libcurl to follow redirection */
+  curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1L);
+
+  /* disable progress meter, set to 0L to enable and disable debug output */
+  curl_easy_setopt(curl_handle, CURLOPT_NOPROGRESS, 1L);
+
+  /* never wait forever on a call, and no signals from the resolver */
+  curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, HITTA_TIMEOUT);
+  curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1L);
+
+  /* keep the connection open between calls, and the address resolved */
+  curl_easy_setopt(curl_handle, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt(curl_handle, CURLOPT_DNS_CACHE_TIMEOUT, HITTA_DNSTTL);
+  curl_easy_setopt(curl_handle, CURLOPT_SHARE, share_handle);
+
+  /* send all data to this function  */
+  curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, writeParseCallback);
+
+  return curl_handle;
+}
+/* keep a curl handle for the next lookup */
+static void putHandle(CURL *curl_handle) {
+  if (idleCount < HITTA_IDLE) idleHandle[idleCount++] = curl_handle;
+  else curl_easy_cleanup(curl_handle);
+}
+/* may a provider be asked, the first request after open is a probe */
+static int breakerAllow(struct hittaProvider *prov) {
+  char msgbuf[BUFSIZ];
+
+  switch (prov->breaker) {
+    case BREAKER_CLOSED:
+      return 1;
+    case BREAKER_OPEN:
+      if (hittaNow() < prov->breaker_until) return 0;
+      prov->breaker = BREAKER_PROBE;
+      prov->breaker_until = hittaNow();
+      sprintf(msgbuf, "%s breaker probe\n", prov->name);
+      logMsg(LEVEL3, msgbuf);
+      return 1;
+    default:
+      /* one probe at a time, unless it was lost */
+      if (hittaNow() < prov->breaker_until + HITTA_TIMEOUT * 1000L) return 0;
+      prov->breaker_until = hittaNow();
+      return 1;
+  }
+}
+/* count a request that failed or was too slow, or close on success */
+/*
+ * count the result of a request started at started; while the breaker
+ * is open, and for the requests from before the probe, the results are
+ * of requests sent before it opened, and only the probe counts
+ */
+static void breakerResult(struct hittaProvider *prov, long started, int failed) {
+  char msgbuf[BUFSIZ];
+
+  if (prov->breaker == BREAKER_OPEN) return;
+  if (prov->breaker == BREAKER_PROBE && started < prov->breaker_until) return;
+
+  if (!failed) {
+    if (prov->breaker != BREAKER_CLOSED) {
+      sprintf(msgbuf, "%s breaker closed\n", prov->name);
+      logMsg(LEVEL1, msgbuf);
+    }
+    prov->breaker = BREAKER_CLOSED;
+    prov->failures = 0;
+    prov->backoff = 0;
+    return;
+  }
+
+  ++prov->failures;
+  if (!hittatrip || (prov->breaker != BREAKER_PROBE && prov->failures < hittatrip)) return;
+
+  prov->backoff = prov->backoff ? prov->backoff * 2 : HITTA_BACKOFF;
+  if (prov->backoff > HITTA_BACKMAX) prov->backoff = HITTA_BACKMAX;
+  prov->breaker = BREAKER_OPEN;
+  prov->breaker_until = hittaNow() + prov->backoff * 1000L;
+
+  sprintf(msgbuf, "%s breaker open for %lds after %d failures\n",
+    prov->name, prov->backoff, prov->failures);
+  logMsg(LEVEL1, msgbuf);
+}
+/*
+ * ms to wait for a provider before the next is asked too, the
+ * hittahedge percentile of its last answer times
+ */
+static long hedgeDelay(struct hittaProvider *prov) {
+  long sorted[HITTA_SAMPLES], ms;
+  int  n, i, j;
+
+  n = prov->samples < HITTA_SAMPLES ? prov->samples : HITTA_SAMPLES;
+  if (n < HITTA_SAMPLES / 4) return HITTA_HEDGE;
+
+  /* insertion sort, there are only a few */
+  for (i = 0; i < n; i++) {
+    for (ms = prov->latency[i], j = i; j > 0 && sorted[j - 1] > ms; j--)
+      sorted[j] = sorted[j - 1];
+    sorted[j] = ms;
+  }
+  ms = sorted[n * hittahedge / 100];
+
+  return ms < HITTA_HEDGEMIN ? HITTA_HEDGEMIN : ms;
+}
+/* add the tokens of the time since the last refill */
+static void rateRefill(void) {
+  long now = hittaNow();
+
+  if (tokens < 0) tokens = hittaburst;
+  tokens += (now - refilled) * hittarate / 60000.0;
+  if (tokens > hittaburst) tokens = hittaburst;
+  refilled = now;
+}
+/*
+ * take a token for a request of a lookup, a background lookup leaves
+ * hittareserve tokens and waits for the calls' lookups in the queue
+ * returns 1 if it may be sent
+ */
+static int rateTake(struct hittaLookup *lookup) {
+  if (!hittarate) return 1;
+  rateRefill();
+
+  if (lookup->priority == HITTA_BACKGROUND
+      && (queuelen || tokens < 1 + hittareserve)) return 0;
+  if (tokens < 1) return 0;
+  tokens -= 1;
+
+  return 1;
+}
+/*
+ * over the rate limit: a call waits in the queue, the rest is refused
+ * returns 0 if it waits, -1 if it is refused
+ */
+static int rateLimited(struct hittaLookup *lookup, const char *name) {
+  char msgbuf[BUFSIZ];
+
+  if (lookup->priority == HITTA_LIVE && queuelen < HITTA_QUEUE) {
+    lookup->queued = hittaNow();
+    queuelen++;
+    ratequeued++;
+    sprintf(msgbuf, "%s %s waits for the rate limit\n", name, lookup->nmbr);
+    logMsg(LEVEL4, msgbuf);
+    return 0;
+  }
+  raterefused++;
+  sprintf(msgbuf, "%s %s refused by the rate limit\n", name, lookup->nmbr);
+  logMsg(LEVEL3, msgbuf);
+
+  return -1;
+}
+/* ms until the next token, for a lookup waiting in the queue */
+static long rateWait(void) {
+  rateRefill();
+  return tokens >= 1 ? 0 : (long) ((1 - tokens) * 60000 / hittarate) + 1;
+}
+/* add a caller to a lookup, returns -1 if there is no memory */
+static int addWaiter(struct hittaLookup *lookup, char *name,
+                     void (*done)(char *name, void *arg), void *arg) {
+  struct hittaWaiter *waiter, **wp;
+
+  if (!(waiter = calloc(1, sizeof(struct hittaWaiter)))) return -1;
+  waiter->done = done;
+  waiter->arg = arg;
+  strncpy(waiter->prev, name, CIDSIZE - 1);
+  for (wp = &lookup->waiters; *wp; wp = &(*wp)->next);
+  *wp = waiter;
+
+  return 0;
+}
+/* the lookup started for a number, or NULL */
+static struct hittaLookup *findLookup(char *nmbr) {
+  struct hittaLookup *lookup;
+
+  for (lookup = inflight; lookup && strcmp(lookup->nmbr, nmbr); lookup = lookup->next);
+  return lookup;
+}
+/*
+ * ask a provider for the name of the number of a lookup
+ * returns 0, or -1 with the reason in msgbuf
+ */
+static int newRequest(struct hittaLookup *lookup, struct hittaProvider *prov, char *msgbuf) {
+  CURL    *curl_handle;
+  char    *ptr;
+  struct   hittaRequest *req;
+  struct   arena *saved;
+  int      i;
+
+  for (i = 0; i < HITTA_PROVIDERS && lookup->request[i]; i++);
+  if (i == HITTA_PROVIDERS) {
+    strcpy(msgbuf, "Error in newRequest->No request slot");
+    return -1;
+  }
+
+  if (!(req = calloc(1, sizeof(struct hittaRequest)))) {
+    strcpy(msgbuf, "Error in newRequest->No memory");
+    return -1;
+  }
+  req->lookup = lookup;
+  req->prov = prov;
+  req->started = hittaNow();
+
+  /* create url, the number in place of %s */
+  ptr = strstr(prov->url, "%s");
+  sprintf(req->url_buffer, "%.*s%s%s", (int) (ptr - prov->url), prov->url, lookup->nmbr, ptr + 2);
+
+  /* a push parser, curl gives it the page in parts */
+  req->class = -1;
+  if (hittaarena && !(req->arena = arenaNew())) {
+    strcpy(msgbuf, "Error in newRequest->No arena");
+    free(req);
+    return -1;
+  }
+  saved = arenaUse(req->arena);
+  req->parser = htmlCreatePushParserCtxt(&hittaSAX, NULL, NULL, 0, NULL, XML_CHAR_ENCODING_NONE);
+  if (req->parser)
+    htmlCtxtUseOptions(req->parser, HTML_PARSE_RECOVER | HTML_PARSE_NOERROR | HTML_PARSE_NOWARNING);
+  arenaUse(saved);
+  if (!req->parser) {
+    strcpy(msgbuf, "Error in htmlCreatePushParserCtxt");
+    freeParser(req);
+    free(req);
+    return -1;
+  }
+  req->parser->_private = req;
+
+  /* a curl handle from the last lookup, or a new one */
+  curl_handle = getHandle();
+
+  /* check if a handle was received */
+  if (!curl_handle) {
+    strcpy(msgbuf, "Error in curl->No curl_handle");
+    freeParser(req);
+    free(req);
+    return -1;
+  }
+  req->curl_handle = curl_handle;
+
+  /* set URL to get here */
+  curl_easy_setopt(curl_handle, CURLOPT_URL, req->url_buffer);
+
+  /* pass the request to the callback function */
+  curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)req);
+
+  /* find the request again when curl is done with it */
+  curl_easy_setopt(curl_handle, CURLOPT_PRIVATE, (void *) req);
+
+  /* get it, the timer callback starts the transfer from the poll() loop */
+  if (curl_multi_add_handle(multi_handle, curl_handle) != CURLM_OK) {
+    strcpy(msgbuf, "Error in curl->Not CURLM_OK");
+    putHandle(curl_handle);
+    freeParser(req);
+    free(req);
+    return -1;
+  }
+  lookup->request[i] = req;
+
+  return 0;
+}
+/* stop a request, finished or not, and free it */
+static void endRequest(struct hittaRequest *req) {
+  struct hittaLookup *lookup = req->lookup;
+  int i;
+
+  for (i = 0; i < HITTA_PROVIDERS; i++)
+    if (lookup->request[i] == req) lookup->request[i] = NULL;
+
+  /* the connection stays in the multi handle for the next lookup */
+  curl_multi_remove_handle(multi_handle, req->curl_handle);
+  putHandle(req->curl_handle);
+
+  /* free the tree and the parser */
+  freeParser(req);
+  free(req);
+}
+/*
+ * ask the next provider of the chain whose breaker lets it, and set
+ * when the one after it is asked too if hedging
+ * returns 0, or -1 if no provider is left or the rate limit refused it
+ */
+static int nextRequest(struct hittaLookup *lookup) {
+  struct hittaProvider *prov;
+  char   msgbuf[BUFSIZ], reason[BUFSIZ];
+  int    i;
+
+  lookup->hedge = 0;
+
+  /* a helper asks the whole chain */
+  if (hittahelpers) return helperRequest(lookup);
+
+  while (lookup->asked < chainlen) {
+    prov = chain[lookup->asked++];
+
+    /* the provider is failing, do not wait for it */
+    if (!breakerAllow(prov)) {
+      sprintf(msgbuf, "%s breaker open, not asked\n", prov->name);
+      logMsg(LEVEL4, msgbuf);
+      continue;
+    }
+
+    /* over the rate limit: no hedge, a call waits, the rest is refused */
+    if (!rateTake(lookup)) {
+      lookup->asked--;
+      for (i = 0; i < HITTA_PROVIDERS && !lookup->request[i]; i++);
+      return i < HITTA_PROVIDERS ? 0 : rateLimited(lookup, prov->name);
+    }
+
+    if (newRequest(lookup, prov, reason)) {
+      sprintf(msgbuf, "%s %s: %s\n", prov->name, lookup->nmbr, reason);
+      logMsg(LEVEL1, msgbuf);
+      continue;
+    }
+
+    if (hittahedge && lookup->asked < chainlen)
+      lookup->hedge = hittaNow() + hedgeDelay(prov);
+    return 0;
+  }
+
+  return -1;
+}
+/*
+ * a lookup has its answer, or none: hand it to the callers
+ * class is -1 if the rate limit stopped it, that is not cached
+ */
+static void endLookup(struct hittaLookup *lookup, int class) {
+  struct hittaLookup **lp;
+  struct hittaWaiter *waiter;
+
+  if (usecache && class >= 0) cacheStore(lookup->nmbr, lookup->name, class, time(0));
+
+  /* a new call for the number now uses the cache */
+  for (lp = &inflight; *lp != lookup; lp = &(*lp)->next);
+  *lp = lookup->next;
+
+  /* an error is not a name, each call keeps the one it had */
+  endclass = class;
+  while ((waiter = lookup->waiters)) {
+    lookup->waiters = waiter->next;
+    waiter->done(class == CACHE_ERROR || class < 0 ? waiter->prev : lookup->name, waiter->arg);
+    free(waiter);
+  }
+  free(lookup);
+}
+/*
+ * finish all requests curl is done with: the first answer that is not
+ * an error ends the lookup, after an error the next provider is asked
+ */
+static void checkDone(void) {
+  CURLMsg  *msg;
+  CURLcode  curl_code;
+  int       left, class, i;
+  long      ms;
+  curl_off_t us;
+  struct    hittaRequest *req;
+  struct    hittaLookup *lookup;
+  struct    hittaProvider *prov;
+  struct    arena *saved;
+  char      msgbuf[BUFSIZ];
+
+  while ((msg = curl_multi_info_read(multi_handle, &left))) {
+    if (msg->msg != CURLMSG_DONE) continue;
+
+    /* msg is not valid after the handle is removed */
+    curl_code = msg->data.result;
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **) &req);
+    lookup = req->lookup;
+    prov = req->prov;
+
+    /* found while downloading, curl_code is an error if it was stopped */
+    if ((class = req->class) >= 0) {
+      sprintf(msgbuf, "%s name after %lu bytes%s\n", prov->name,
+        (unsigned long) req->bytes, curl_code == CURLE_OK ? "" : ", stopped");
+      logMsg(LEVEL4, msgbuf);
+    }
+    /* check for curl errors */
+    else if (curl_code == CURLE_OK) {
+      /* end of page, the nodes at the end are complete now */
+      saved = arenaUse(req->arena);
+      us = hittaMicro();
+      htmlParseChunk(req->parser, NULL, 0, 1);
+      req->parse_us += hittaMicro() - us;
+      class = hittaMatch(req, 1);
+      arenaUse(saved);
+    }
+    else {
+      strncpy(req->name, "Error in curl->Not CURL_OK", CIDSIZE - 1);
+      class = CACHE_ERROR;
+    }
+
+    phaseRecord(req);
+    ms = hittaNow() - req->started;
+    breakerResult(prov, req->started, class == CACHE_ERROR || (hittaslow && ms > hittaslow));
+    if (class != CACHE_ERROR) prov->latency[prov->samples++ % HITTA_SAMPLES] = ms;
+    else {
+      sprintf(msgbuf, "%s %s: %s\n", prov->name, lookup->nmbr, req->name);
+      logMsg(LEVEL3, msgbuf);
+    }
+    strcpy(lookup->name, req->name);
+    endRequest(req);
+
+    if (class != CACHE_ERROR) {
+      /* the first answer is taken, the other providers are stopped */
+      for (i = 0; i < HITTA_PROVIDERS; i++) {
+        if (!lookup->request[i]) continue;
+        sprintf(msgbuf, "%s request cancelled, %s answered\n",
+          lookup->request[i]->prov->name, prov->name);
+        logMsg(LEVEL4, msgbuf);
+        endRequest(lookup->request[i]);
+      }
+      endLookup(lookup, class);
+      continue;
+    }
+
+    /* wait for a provider still asked, or ask the next */
+    for (i = 0; i < HITTA_PROVIDERS && !lookup->request[i]; i++);
+    if (i < HITTA_PROVIDERS || !nextRequest(lookup)) continue;
+
+    endLookup(lookup, CACHE_ERROR);
+  }
+}
+/* curl wants a socket watched, or not watched anymore */
+static int socketCallback(CURL *easy, curl_socket_t s, int what, void *userp, void *socketp) {
+  int  pos = socketp ? (int) (long) socketp - 1 : -1;
+  char msgbuf[BUFSIZ];
+
+  if (what == CURL_POLL_REMOVE) {
+    if (pos >= 0 && polld[pos].fd == s) {
+      lookupPoll[pos] = 0;
+      delPoll(pos);
+    }
+    return 0;
+  }
+
+  if (pos < 0) {
+    if ((pos = addPoll(s)) < 0) {
+      sprintf(msgbuf, "No poll slot for hitta.se socket %d\n", s);
+      logMsg(LEVEL1, msgbuf);
+      return -1;
+    }
+    lookupPoll[pos] = 1;
+    curl_multi_assign(multi_handle, s, (void *) (long) (pos + 1));
+    sprintf(msgbuf, "hitta.se socket is sd %d pos %d\n", s, pos);
+    logMsg(LEVEL9, msgbuf);
+  }
+
+  setPoll(pos, (what & CURL_POLL_IN ? POLLIN : 0) | (what & CURL_POLL_OUT ? POLLOUT : 0));
+
+  return 0;
+}
+/* curl wants to be called after timeout_ms */
+static int timerCallback(CURLM *multi, long timeout_ms, void *userp) {
+  multi_timeout = timeout_ms;
+  if (timeout_ms >= 0) multi_deadline = hittaNow() + timeout_ms;
+
+  return 0;
+}
+/* RSS of this process in KB, 0 if it is not known */
+static uint32_t helperRss(void) {
+  long pages, rss = 0;
+  FILE *fp;
+
+  if ((fp = fopen("/proc/self/statm", "r"))) {
+    if (fscanf(fp, "%ld %ld", &pages, &rss) != 2) rss = 0;
+    fclose(fp);
+  }
+  return (uint32_t) (rss * (sysconf(_SC_PAGESIZE) / 1024));
+}
+/* write a frame, len bytes after its length, returns -1 if it was not */
+static int helperWrite(int fd, unsigned char *frame, uint32_t len) {
+  memcpy(frame, &len, 4);
+  return write(fd, frame, len + 4) == (ssize_t) (len + 4) ? 0 : -1;
+}
+/* in a helper, the name of a number goes back to ncidd */
+static void helperAnswer(int fd, uint32_t id, int class, char *name) {
+  unsigned char frame[HITTA_FRAME];
+  uint32_t rss = helperRss(), len = strlen(name);
+
+  memcpy(frame + 4, &id, 4);
+  frame[8] = (unsigned char) class;
+  memcpy(frame + 9, &rss, 4);
+  memcpy(frame + 13, name, len);
+  if (helperWrite(fd, frame, len + 9)) _exit(1);
+}
+static void helperDone(char *name, void *arg) {
+  helperAnswer(helperfd, (uint32_t) (long) arg, endclass, name);
+}
+/*
+ * a helper process: look up the numbers ncidd sends, with the chain
+ * but without the phonebook, the cache and the rate limit, which ncidd
+ * keeps; it ends when ncidd closes its socket
+ */
+static void helperMain(int fd) {
+  unsigned char in[HITTA_FRAME * 4];
+  size_t   inlen = 0;
+  uint32_t len, id;
+  char     nmbr[CIDSIZE], name[CIDSIZE];
+  int      i, pos, sock, events;
+  ssize_t  n;
+
+  helperfd = fd;
+  hittahelpers = hittarate = 0;
+  usecache = usebook = warming = queuelen = 0;
+  inflight = NULL;
+  memset(helper, 0, sizeof(helper));
+
+  /* the signals are for ncidd */
+  signal(SIGHUP, SIG_DFL);
+  signal(SIGINT, SIG_DFL);
+  signal(SIGQUIT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  signal(SIGALRM, SIG_DFL);
+  signal(SIGUSR1, SIG_DFL);
+  signal(SIGUSR2, SIG_DFL);
+  signal(SIGPIPE, SIG_IGN);
+
+  /* so are its clients, the tty and the other helpers */
+  for (i = 0; i < pollused; i++) close(polld[pollslot[i]].fd);
+  pollReset();
+  if ((sock = addPoll(fd)) < 0) _exit(1);
+
+  while (1) {
+    if ((events = waitPoll(hittaTimeout(1000))) < 0 && errno != EINTR)
+      _exit(1);
+    for (i = 0; i < events; i++) {
+      pos = pollready[i];
+      if (lookupPoll[pos]) hittaEvent(pos, polld[pos].revents);
+      else if (pos == sock) {
+        if ((n = read(fd, in + inlen, sizeof(in) - inlen)) <= 0) _exit(0);
+        inlen += n;
+
+        /* each frame is an id and a number */
+        while (inlen >= 4) {
+          memcpy(&len, in, 4);
+          if (len < 5 || len - 4 >= CIDSIZE) _exit(1);
+          if (inlen < len + 4) break;
+          memcpy(&id, in + 4, 4);
+          sprintf(nmbr, "%.*s", (int) (len - 4), (char *) in + 8);
+          inlen -= len + 4;
+          memmove(in, in + len + 4, inlen);
+
+          *name = 0;
+          if (!hittaAlias(name, nmbr, HITTA_LIVE, helperDone, (void *) (long) id))
+            helperAnswer(fd, id, CACHE_ERROR, name);
+        }
+      }
+      polld[pos].revents = 0;
+    }
+    hittaTimer();
+  }
+}
+/* fork helper i, returns -1 if it could not */
+static int helperStart(int i) {
+  struct hittaHelper *hp = &helper[i];
+  char msgbuf[BUFSIZ];
+  int  sv[2], pos;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) return -1;
+  if ((hp->pid = fork()) < 0) {
+    close(sv[0]);
+    close(sv[1]);
+    hp->pid = 0;
+    return -1;
+  }
+  if (!hp->pid) {
+    close(sv[0]);
+    helperMain(sv[1]);
+  }
+  close(sv[1]);
+
+  if ((pos = addPoll(sv[0])) < 0) {
+    close(sv[0]);
+    kill(hp->pid, SIGKILL);
+    waitpid(hp->pid, NULL, 0);
+    hp->pid = 0;
+    return -1;
+  }
+  fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+  setPoll(pos, POLLIN);
+  helperPoll[pos] = i + 1;
+  hp->fd = sv[0];
+  hp->pos = pos;
+  hp->served = hp->inlen = 0;
+  hp->busy = hp->draining = 0;
+
+  sprintf(msgbuf, "hitta.se helper %d started, pid %d\n", i, (int) hp->pid);
+  logMsg(LEVEL3, msgbuf);
+
+  return 0;
+}
+/*
+ * stop helper i; unless ncidd is ending, its lookups end without a
+ * name and a new helper is started
+ */
+static void helperStop(int i, const char *why, int ending) {
+  struct hittaHelper *hp = &helper[i];
+  struct hittaLookup *lookup;
+  char msgbuf[BUFSIZ];
+
+  if (!hp->pid) return;
+  helperPoll[hp->pos] = 0;
+  closePoll(hp->pos);
+  kill(hp->pid, SIGKILL);
+  waitpid(hp->pid, NULL, 0);
+
+  sprintf(msgbuf, "hitta.se helper %d pid %d stopped, %s, %lu numbers\n",
+    i, (int) hp->pid, why, hp->served);
+  logMsg(LEVEL3, msgbuf);
+  hp->pid = 0;
+  if (ending) return;
+
+  /* ending a lookup changes the list, look again after each */
+  do {
+    for (lookup = inflight; lookup && lookup->helper != i + 1; lookup = lookup->next);
+    if (lookup) {
+      lookup->helper = 0;
+      strncpy(lookup->name, "Error in helper->Stopped", CIDSIZE - 1);
+      endLookup(lookup, CACHE_ERROR);
+    }
+  } while (lookup);
+
+  if (helperStart(i)) {
+    sprintf(msgbuf, "hitta.se helper %d: cannot start: %s\n", i, strerror(errno));
+    logMsg(LEVEL1, msgbuf);
+  }
+}
+/*
+ * send a lookup to the least busy helper, after the rate limit
+ * returns 0, or -1 if it was refused or there is no helper
+ */
+static int helperRequest(struct hittaLookup *lookup) {
+  struct hittaHelper *hp, *best = NULL;
+  unsigned char frame[HITTA_FRAME];
+  uint32_t len = strlen(lookup->nmbr);
+  int i;
+
+  if (!rateTake(lookup)) return rateLimited(lookup, "helper");
+
+  /* one that is to be replaced only if all are, it is a bit late then */
+  for (i = 0; i < hittahelpers; i++) {
+    hp = &helper[i];
+    if (!hp->pid || (best && (hp->draining > best->draining ||
+        (hp->draining == best->draining && hp->busy >= best->busy)))) continue;
+    best = hp;
+  }
+  if (!best) {
+    logMsg(LEVEL1, "hitta.se no helper running\n");
+    return -1;
+  }
+
+  lookup->id = ++helperid;
+  memcpy(frame + 4, &lookup->id, 4);
+  memcpy(frame + 8, lookup->nmbr, len);
+  if (helperWrite(best->fd, frame, len + 4)) {
+    helperStop(best - helper, "not writable", 0);
+    return -1;
+  }
+  lookup->helper = best - helper + 1;
+  lookup->sent = hittaNow();
+  best->busy++;
+  if (hittarecycle && ++best->served >= (unsigned long) hittarecycle) best->draining = 1;
+
+  return 0;
+}
+/* names from helper i; it is replaced when it should be and is idle */
+static void helperRead(int i) {
+  struct hittaHelper *hp = &helper[i];
+  struct hittaLookup *lookup;
+  uint32_t len, id, rss;
+  int      class;
+  char     name[CIDSIZE], msgbuf[BUFSIZ];
+  ssize_t  n;
+
+  if ((n = read(hp->fd, hp->in + hp->inlen, sizeof(hp->in) - hp->inlen)) <= 0) {
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    helperStop(i, "exited", 0);
+    return;
+  }
+  hp->inlen += n;
+
+  /* each frame is an id, a class, the helper's RSS and a name */
+  while (hp->inlen >= 4) {
+    memcpy(&len, hp->in, 4);
+    if (len < 9 || len - 9 >= CIDSIZE) {
+      helperStop(i, "bad frame", 0);
+      return;
+    }
+    if (hp->inlen < len + 4) break;
+    memcpy(&id, hp->in + 4, 4);
+    class = hp->in[8];
+    memcpy(&rss, hp->in + 9, 4);
+    sprintf(name, "%.*s", (int) (len - 9), (char *) hp->in + 13);
+    hp->inlen -= len + 4;
+    memmove(hp->in, hp->in + len + 4, hp->inlen);
+
+    if (hittahelpermem && rss > (uint32_t) hittahelpermem && !hp->draining) {
+      sprintf(msgbuf, "hitta.se helper %d uses %lu KB, replaced\n", i, (unsigned long) rss);
+      logMsg(LEVEL3, msgbuf);
+      hp->draining = 1;
+    }
+
+    for (lookup = inflight; lookup && (lookup->helper != i + 1 || lookup->id != id);
+         lookup = lookup->next);
+    if (!lookup) continue;
+    hp->busy--;
+    lookup->helper = 0;
+    strcpy(lookup->name, name);
+    endLookup(lookup, class > CACHE_ERROR ? CACHE_ERROR : class);
+  }
+
+  if (hp->draining && !hp->busy) helperStop(i, "replaced", 0);
+}
+/* a helper that has not answered long after curl would have given up is hung */
+static void helperCheck(void) {
+  struct hittaLookup *lookup;
+
+  do {
+    for (lookup = inflight; lookup; lookup = lookup->next)
+      if (lookup->helper && hittaNow() - lookup->sent > HITTA_TIMEOUT * 1000 + HITTA_HUNG) break;
+    if (lookup) helperStop(lookup->helper - 1, "hung", 0);
+  } while (lookup);
+}
+/*
+ * set a hitta.se lookup option from a "word=value" string
+ * returns 0, or -1 if the word or the value is not valid
+ */
+int hittaSet(char *option) {
+  struct hittaword *wp;
+  char *vptr, *eptr;
+  long  value;
+
+  if (!(vptr = strchr(option, '='))) return -1;
+  for (wp = hittaword; wp->word; ++wp) {
+    if (strlen(wp->word) == (size_t) (vptr - option)
+        && !strncmp(wp->word, option, vptr - option)) break;
+  }
+  if (!wp->word) return -1;
+
+  if (wp->set) return wp->set(++vptr);
+
+  if (wp->string) {
+    /* an empty string turns the setting off */
+    *wp->string = ++vptr;
+    return 0;
+  }
+
+  value = strtol(++vptr, &eptr, 10);
+  if (eptr == vptr || *eptr || value < wp->min || value > wp->max) return -1;
+  *wp->value = (int) value;
+
+  return 0;
+}
+int hittaInit(void) {
+  int i;
+
+  /* which slots of polld[] are ours, grown with it */
+  if (pollTable(&lookupPoll, sizeof(char)) || pollTable(&helperPoll, sizeof(char)))
+    return -1;
+
+  if (cacheInit()) return -1;
+  if (chainInit()) return -1;
+
+  /* no phonebook yet is fine, it is mapped once it is made */
+  if (usebook) (void) bookOpen();
+
+  /* names of the calls in the log, read from the poll() loop */
+  if (usecache && cachewarm) warming = cacheWarm(cidlog, hittaTidy, warmClass);
+
+  /* the arena functions must be set before libxml2 allocates */
+  if (hittaarena && arenaInstall()) return -1;
+  xmlInitParser();
+  for (i = 0; i < providers; i++)
+    if (providerInit(&provider[i])) return -1;
+  if (!(xpath_context = xmlXPathNewContext(NULL))) return -1;
+
+  /* the default html SAX handler builds the tree */
+  xmlSAX2InitHtmlDefaultSAXHandler(&hittaSAX);
+  hittaSAX.startElement = startElement;
+
+  if (curl_global_init(CURL_GLOBAL_ALL) != CURLE_OK) return -1;
+
+  if (!(multi_handle = curl_multi_init())) return -1;
+  curl_multi_setopt(multi_handle, CURLMOPT_SOCKETFUNCTION, socketCallback);
+  curl_multi_setopt(multi_handle, CURLMOPT_TIMERFUNCTION, timerCallback);
+  curl_multi_setopt(multi_handle, CURLMOPT_MAXCONNECTS, (long) HITTA_IDLE);
+
+  /* one cache of addresses and TLS sessions for all lookups */
+  if (!(share_handle = curl_share_init())) return -1;
+  curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+  /* modify a header curl otherwise adds differently */
+  if (!(http_headers = curl_slist_append(NULL, HEADER_ACCEPT))) return -1;
+
+  /* the helpers are forked last, with all they need set up */
+  for (i = 0; i < hittahelpers; i++)
+    if (helperStart(i)) return -1;
+
+  return 0;
+}
+void hittaCleanup(void) {
+  int i, pos;
+
+  for (i = 0; i < HITTA_HELPERS; i++) helperStop(i, "ending", 1);
+
+  /*
+   * curl closes its sockets without CURL_POLL_REMOVE for each, so their
+   * slots go first, or closing polld[] would close them again
+   */
+  for (pos = 0; lookupPoll && pos < pollsize; pos++) {
+    if (!lookupPoll[pos]) continue;
+    lookupPoll[pos] = 0;
+    delPoll(pos);
+  }
+
+  /* the easy handles must go before the multi and share handles */
+  while (idleCount) curl_easy_cleanup(idleHandle[--idleCount]);
+  if (multi_handle) {
+    curl_multi_cleanup(multi_handle);
+    multi_handle = NULL;
+  }
+  if (share_handle) {
+    curl_share_cleanup(share_handle);
+    share_handle = NULL;
+  }
+  curl_slist_free_all(http_headers);
+  http_headers = NULL;
+  curl_global_cleanup();
+  for (i = 0; i < providers; i++) {
+    if (provider[i].xpath_all) {
+      xmlXPathFreeCompExpr(provider[i].xpath_all);
+      provider[i].xpath_all = NULL;
+    }
+  }
+  if (xpath_context) {
+    xmlXPathFreeContext(xpath_context);
+    xpath_context = NULL;
+  }
+  xmlCleanupParser();
+  cacheCleanup();
+  bookClose();
+}
+/* is polld[pos] a lookup socket */
+int hittaSocket(int pos) {
+  /* not before hittaInit() */
+  if (!lookupPoll) return 0;
+
+  return lookupPoll[pos] || helperPoll[pos];
+}
+/* a lookup socket in polld[pos] has events */
+void hittaEvent(int pos, int revents) {
+  int flags = 0, running;
+
+  if (helperPoll[pos]) {
+    helperRead(helperPoll[pos] - 1);
+    return;
+  }
+
+  if (revents & (POLLIN | POLLPRI | POLLHUP)) flags |= CURL_CSELECT_IN;
+  if (revents & POLLOUT) flags |= CURL_CSELECT_OUT;
+  if (revents & (POLLERR | POLLNVAL)) flags |= CURL_CSELECT_ERR;
+
+  curl_multi_socket_action(multi_handle, polld[pos].fd, flags, &running);
+  checkDone();
+}
+/*
+ * poll() timeout, shortened if the curl timer or a hedge is before it,
+ * and no wait while the call log is read into the cache
+ */
+int hittaTimeout(int timeout) {
+  struct hittaLookup *lookup;
+  long left, now = hittaNow();
+
+  if (warming) return 0;
+
+  if (multi_timeout >= 0) {
+    left = multi_deadline - now;
+    if (left < 0) left = 0;
+    if (left < timeout) timeout = (int) left;
+  }
+
+  for (lookup = inflight; lookup; lookup = lookup->next) {
+    if (lookup->helper) left = lookup->sent + HITTA_TIMEOUT * 1000 + HITTA_HUNG - now;
+    else if (!lookup->hedge) continue;
+    else left = lookup->hedge - now;
+    if (left < 0) left = 0;
+    if (left < timeout) timeout = (int) left;
+  }
+
+  /* the queue moves with the next token */
+  if (queuelen && (left = rateWait()) < timeout) timeout = (int) left;
+
+  return timeout;
+}
+/*
+ * start the lookups of the queue the rate limit lets through, oldest
+ * first, and give up on the ones that waited HITTA_TIMEOUT
+ */
+static void rateQueue(void) {
+  struct hittaLookup *lookup, *oldest;
+  char msgbuf[BUFSIZ];
+  long waited;
+
+  while (queuelen) {
+    for (oldest = NULL, lookup = inflight; lookup; lookup = lookup->next)
+      if (lookup->queued && (!oldest || lookup->queued < oldest->queued)) oldest = lookup;
+
+    waited = hittaNow() - oldest->queued;
+    if (waited < HITTA_TIMEOUT * 1000 && rateWait()) break;
+    oldest->queued = 0;
+    queuelen--;
+    if (waited >= HITTA_TIMEOUT * 1000) {
+      sprintf(msgbuf, "%s waited too long for the rate limit\n", oldest->nmbr);
+      logMsg(LEVEL3, msgbuf);
+      endLookup(oldest, -1);
+    }
+    else if (nextRequest(oldest)) endLookup(oldest, -1);
+  }
+}
+/*
+ * ask the next provider for slow lookups, start the lookups the rate
+ * limit lets through, read more of the call log, and run curl if its
+ * timer expired
+ */
+void hittaTimer(void) {
+  struct hittaLookup *lookup;
+  char msgbuf[BUFSIZ];
+  int  running;
+
+  if (warming) warming = cacheWarmStep();
+  if (queuelen) rateQueue();
+  if (hittahelpers) helperCheck();
+
+  for (lookup = inflight; lookup; lookup = lookup->next) {
+    if (!lookup->hedge || hittaNow() < lookup->hedge) continue;
+    sprintf(msgbuf, "hedge: %s is slow, asking the next provider too\n",
+      chain[lookup->asked - 1]->name);
+    logMsg(LEVEL4, msgbuf);
+    nextRequest(lookup);
+  }
+
+  if (multi_timeout < 0 || hittaNow() < multi_deadline) return;
+
+  /* the callback sets a new timer if curl wants one */
+  multi_timeout = -1;
+  curl_multi_socket_action(multi_handle, CURL_SOCKET_TIMEOUT, 0, &running);
+  checkDone();
+}
+/*
+ * look up again at most hittarefresh numbers called often whose names
+ * expire soon, as background lookups so the rate limit keeps its
+ * tokens for the calls, and compact the cache file if it is due;
+ * ncidd calls it when poll() times out idle
+ */
+void hittaRefresh(void) {
+  struct hittaLookup *lookup;
+  char nmbr[CIDSIZE], msgbuf[BUFSIZ];
+  int  i;
+
+  if (!usecache || warming) return;
+
+  cacheCompact();
+
+  for (i = 0; i < hittarefresh && cacheRefresh(nmbr); i++) {
+    if (findLookup(nmbr)) continue;
+    if (!(lookup = calloc(1, sizeof(struct hittaLookup)))) return;
+    strncpy(lookup->nmbr, nmbr, CIDSIZE - 1);
+    lookup->priority = HITTA_BACKGROUND;
+
+    /* refused or no provider, try again on a later time out */
+    if (nextRequest(lookup)) {
+      free(lookup);
+      return;
+    }
+    cacheRefreshed(nmbr);
+    lookup->next = inflight;
+    inflight = lookup;
+
+    sprintf(msgbuf, "hitta.se refresh %s before it expires\n", nmbr);
+    logMsg(LEVEL4, msgbuf);
+  }
+}
+/*
+ * the result class of a name in cidcall.log, as hittaMatch() gives it,
+ * or -1 for a name that is not from a lookup: one hittaAlias() sets
+ * itself, an error, or one hittawarmname() refuses, from an alias or
+ * a list
+ */
+static int warmClass(char *nmbr, char *name) {
+  if (!strcmp(name, HITTA_INTER) || !strcmp(name, HITTA_SECUR) ||
+      !strcmp(name, HITTA_SHORT) || !strcmp(name, HITTA_ERROR)) return -1;
+  if (hittawarmname && !hittawarmname(nmbr, name)) return -1;
+  return strcmp(name, HITTA_UNKNOWN) ? CACHE_NAME : CACHE_UNKNOWN;
+}
+/* destination code lengths 1 to 3, indexed by the code */
+static void destTable(void) {
+  const char *ptr;
+  int len = 0, code = 0;
+
+  /* the blanks from the line breaks in SWE_DEST_CODES are skipped */
+  for (ptr = SWE_DEST_CODES; *ptr; ptr++) {
+    if (isdigit(*ptr)) {
+      code = code * 10 + *ptr - '0';
+      len++;
+    }
+    else if (*ptr == '-') {
+      if (len > 0 && len < 4) destCode[len][code] = 1;
+      len = code = 0;
+    }
+  }
+  destInit = 1;
+}
+/*
+ * Tidy a number: remove all non numeric characters, and split a
+ * national number by inserting '-' between Dest.Code & Subscriber number
+ */
+void hittaTidy(char *nmbr) {
+  char  c;
+  char *nmbr_old_ptr = nmbr;
+  char *nmbr_new_ptr = nmbr;
+  char  new_nmbr[CIDSIZE];
+  int   i, len, code[4];
+
+  while ((c = *nmbr_old_ptr++))
+      if (isdigit(c))
+          *nmbr_new_ptr++ = c;
+
+  *nmbr_new_ptr = 0; 
+  len = nmbr_new_ptr - nmbr;
+
+  /* special & to short numbers are not split */
+  if (nmbr[0] != NATIONAL_PREFX || len < 3 || len >= CIDSIZE - 1) return;
+  if (!destInit) destTable();
+
+  /* the longest code that leaves a subscriber number */
+  code[0] = 0;
+  for (i = 1; i < 4 && i < len; i++) code[i] = code[i-1] * 10 + nmbr[i] - '0';
+  for (i--; i > 0 && !destCode[i][code[i]]; i--);
+  if (i == 0) return;
+
+  /* mobile numbers 07X have one more digit before the '-' */
+  if (i == 2 && nmbr[1] == '7' && len > 8
+  && (nmbr[4] != '0' || (nmbr[3] == '0' && nmbr[4] == '0'))) i++;
+
+  memcpy(new_nmbr, nmbr, i + 1);
+  new_nmbr[i + 1] = '-';
+  strcpy(&new_nmbr[i + 2], nmbr + i + 1);
+  strcpy(nmbr, new_nmbr);
+}
+/*
+ * Find name from number, tidy the number
+ *
+ * Returns 0 if the name is in name, returns 1 if a lookup was started,
+ * done(name, arg) is then called from the poll() loop when it finishes.
+ */
+int hittaAlias(char *name, char *nmbr, int priority,
+               void (*done)(char *name, void *arg), void *arg) {
+  struct   hittaLookup *lookup;
+  int      class;
+  char     cached[CIDSIZE];
+
+  /* only digits, with '-' after the destination code */
+  hittaTidy(nmbr);
+
+  /* Check special & to short numbers */
+  if (strcmp(nmbr, "00") == 0) {
+    strncpy(name, HITTA_INTER, CIDSIZE - 1);
+    return 0;
+  }
+  else if (strcmp(nmbr, "10") == 0) {
+    strncpy(name, HITTA_SECUR, CIDSIZE - 1);        
+    return 0;
+  }
+  else if (strlen(nmbr) < 3) {
+    strncpy(name, HITTA_SHORT, CIDSIZE - 1);        
+    return 0;
+  }
+
+  /* known numbers are in the phonebook, no lookup at all */
+  if (usebook && bookFind(nmbr, name)) {
+    logMsg(LEVEL4, "hitta.se name from phonebook\n");
+    return 0;
+  }
+
+  /* numbers called before are in the cache, a recent error too */
+  if (usecache && (class = cacheFind(nmbr, cached)) >= 0) {
+    if (class != CACHE_ERROR) strcpy(name, cached);
+    logMsg(LEVEL4, "hitta.se name from cache\n");
+    return 0;
+  }
+
+  /* the number is being looked up for another call, wait for that */
+  if ((lookup = findLookup(nmbr))) {
+    if (addWaiter(lookup, name, done, arg)) {
+      strncpy(name, "Error in hittaAlias->No memory", CIDSIZE - 1);        
+      return 0;
+    }
+    logMsg(LEVEL4, "hitta.se lookup already started\n");
+    return 1;
+  }
+
+  if (!(lookup = calloc(1, sizeof(struct hittaLookup)))) {
+    strncpy(name, "Error in hittaAlias->No memory", CIDSIZE - 1);        
+    return 0;
+  }
+  strncpy(lookup->nmbr, nmbr, CIDSIZE - 1);
+  lookup->priority = priority;
+
+  /* the first caller, later calls for the number join it */
+  if (addWaiter(lookup, name, done, arg)) {
+    strncpy(name, "Error in hittaAlias->No memory", CIDSIZE - 1);        
+    free(lookup);
+    return 0;
+  }
+
+  /* the first provider of the chain that can be asked, or the queue */
+  if (nextRequest(lookup)) {
+    logMsg(LEVEL4, "hitta.se no provider asked\n");
+    free(lookup->waiters);
+    free(lookup);
+    return 0;
+  }
+  lookup->next = inflight;
+  inflight = lookup;
+
+  return 1;
+}
@@ -0,0 +1,117 @@
+/*
+ * nciddhitta.h - This file is part of ncidd.
+ *
+ * LA: Find Name using hitta.se & tidy Nmbr
+ *
+ * ncidd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ncidd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ncidd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* from ncidd.c, lookup sockets are kept in the poll table of nciddpoll.c */
+extern char *cidlog;
+extern void logMsg();
+
+/* LA: a name from hitta.se for a call line sent without it */
+#define UPDLINE "UPD: "
+
+/* ms a call line waits for its name, 0 waits until the lookup ends */
+#define HITTAWAIT 1500
+
+/* failed lookups in a row that open the breaker, 0 never opens it */
+#define HITTATRIP 3
+
+/* ms a lookup may take before it counts as failed, 0 for no limit */
+#define HITTASLOW 4000
+
+/* percentile of a provider's answer times after which the next
+   provider in the chain is asked too, 0 asks it only after an error */
+#define HITTAHEDGE 0
+
+/* name providers in the order they are asked, phonebook is the local
+   phonebook and cache the number cache, both asked before any other */
+#define HITTACHAIN "phonebook,cache,hitta"
+
+/* requests to the providers a minute, 0 for no limit, and at once */
+#define HITTARATE 60
+#define HITTABURST 10
+
+/* tokens background lookups leave for the lookups of calls */
+#define HITTARESERVE 3
+
+/* hittaAlias() priority, a call first, the rest with what is left */
+#define HITTA_LIVE 0
+#define HITTA_BACKGROUND 1
+
+/* numbers called often looked up again each idle poll() time out,
+   before their names expire, 0 does not */
+#define HITTAREFRESH 1
+
+/* helper processes that do the lookups, 0 does them in ncidd; each
+   helper has its own breakers, hedge delays and phase times, which
+   hittaStats() in ncidd does not see */
+#define HITTAHELPERS 0
+
+/* numbers a helper looks up before it is replaced, 0 for no limit */
+#define HITTARECYCLE 500
+
+/* KB of RSS above which a helper is replaced, 0 for no limit */
+#define HITTAHELPERMEM 65536
+
+/* 1 takes the libxml2 blocks of each request from an arena of its own */
+#define HITTAARENA 0
+
+extern int hittawait, hittatrip, hittaslow, hittahedge;
+extern int hittarate, hittaburst, hittareserve, hittarefresh;
+extern int hittahelpers, hittarecycle, hittahelpermem, hittaarena;
+extern char *hittachain;
+
+/* set by ncidd, 0 if a name in cidcall.log is from an alias or a list */
+extern int (*hittawarmname)(char *nmbr, char *name);
+
+/* Swedish destination codes, hittaTidy() splits a number after one */
+#define NATIONAL_PREFX '0'
+#define SWE_DEST_CODES \
+"-10-11-120-121-122-123-125-13-140-141-142-143-144-150-151-152-155-156-157-158-159-16-\
+ 171-173-174-175-176-18-19-20-21-200-220-221-222-223-224-225-226-227-23-240-241-243-246-247-248-\
+ 250-251-253-258-26-270-271-278-280-281-290-291-292-293-294-295-297-300-301-302-303-304-31-\
+ 320-321-322-325-33-340-345-346-35-36-370-371-372-378-380-381-382-383-390-392-393-40-\
+ 410-411-413-414-415-416-417-418-42-430-431-433-435-44-451-454-455-456-457-459-46-\
+ 470-471-472-474-476-477-478-479-480-481-485-486-490-491-492-493-494-495-496-498-499-\
+ 500-501-502-503-504-505-506-510-511-512-513-514-515-520-521-522-523-524-525-526-528-\
+ 530-531-532-533-534-54-550-551-552-553-554-555-560-563-564-565-570-571-573-\
+ 580-581-582-583-584-585-586-587-589-590-591-60-611-612-613-620-621-622-623-624-63-\
+ 640-642-643-644-645-647-650-651-652-653-657-660-661-662-663-670-671-672-680-682-684-687-\
+ 690-691-692-693-695-696-70-71-72-73-74-75-76-77-78-8-800-90-900-910-911-912-913-914-915-916-918-\
+ 920-921-922-923-924-925-926-927-928-929-930-932-933-934-935-939-940-941-942-943-944-\
+ 950-951-952-953-954-960-961-969-970-971-973-975-976-977-978-980-981-99-"
+
+/*
+ * hittaAlias() returns 0 when the name is already in name, or 1 when a
+ * lookup was started; done(name, arg) is then called from the poll()
+ * loop, by hittaEvent() or hittaTimer(), once the name is known.  It
+ * also returns 0, with name as it was, when the rate limit refuses a
+ * HITTA_BACKGROUND lookup or the queue for HITTA_LIVE ones is full.
+ */
+extern int  hittaSet(char *option);
+extern void hittaTidy(char *nmbr);
+extern int  hittaInit(void);
+extern void hittaCleanup(void);
+extern int  hittaAlias(char *name, char *nmbr, int priority,
+                       void (*done)(char *name, void *arg), void *arg);
+extern int  hittaSocket(int pos);
+extern void hittaEvent(int pos, int revents);
+extern int  hittaTimeout(int timeout);
+extern void hittaTimer(void);
+extern void hittaRefresh(void);
+extern long hittaNow(void);
+extern void hittaStats(void);
@@ -0,0 +1,298 @@
+/*
+ * nciddpoll.c - This file is part of ncidd.
+ *
+ * LA: the poll table of ncidd and the hitta.se lookups
+ *
+ * Every descriptor ncidd waits for, the tty, the server socket, its
+ * clients and the lookup sockets, has a slot in polld[].  Free slots
+ * are kept on a stack, so addPoll() does not search the table, and the
+ * slots in use are listed in pollslot[] for the loops over the clients.
+ * The table starts with POLLSTART slots and doubles when they are all
+ * used, up to pollmax.  What ncidd and the lookups keep for a slot is
+ * in their own tables indexed like polld[], which pollTable() grows
+ * with it.
+ *
+ * On Linux the slots are in an epoll set, with the slot as its data,
+ * and waitPoll() only looks at the descriptors that have events.  The
+ * other targets use poll() on the table and look at every slot.  Either
+ * way waitPoll() lists the slots with events in pollready[], with their
+ * events in polld[pos].revents as poll() sets them.
+ *
+ * ncidd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ncidd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ncidd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ncidd.h"
+#include "nciddpoll.h"
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+struct pollfd *polld;
+int *pollready;                     /* slots with events */
+int *pollslot;                      /* slots in use */
+int pollused, pollsize;
+int pollmax = POLLMAX;
+
+static int *freeslot;               /* free slots, the next on top */
+static int freecount;
+static int *slotindex;              /* where a slot is in pollslot[] */
+
+/* the tables of pollTable(), and the size of an entry of each */
+static void **table[POLLTABLES];
+static size_t tablesize[POLLTABLES];
+static int tables;
+
+#ifdef HAVE_EPOLL
+static int epfd = -1;
+static struct epoll_event *epready;
+#endif
+
+/* grow *ptr from have to size entries of bytes, the new ones 0,
+   it stays as it was if there is no memory */
+static int growTable(void **ptr, int have, int size, size_t bytes)
+{
+    char *grown;
+
+    if (!(grown = (char *) realloc(*ptr, size * bytes))) return -1;
+    memset(grown + have * bytes, 0, (size - have) * bytes);
+    *ptr = grown;
+
+    return 0;
+}
+
+/*
+ * grow every table to size slots, the new slots free
+ * returns -1 if there is no memory, every table then stays as it was
+ */
+static int growAll(int size)
+{
+    void **all[POLLTABLES + 6], *grown[POLLTABLES + 6];
+    size_t bytes[POLLTABLES + 6];
+    int i, count = 0, pos;
+
+    all[count] = (void **) &polld;
+    bytes[count++] = sizeof(struct pollfd);
+    all[count] = (void **) &pollready;
+    bytes[count++] = sizeof(int);
+    all[count] = (void **) &pollslot;
+    bytes[count++] = sizeof(int);
+    all[count] = (void **) &freeslot;
+    bytes[count++] = sizeof(int);
+    all[count] = (void **) &slotindex;
+    bytes[count++] = sizeof(int);
+#ifdef HAVE_EPOLL
+    all[count] = (void **) &epready;
+    bytes[count++] = sizeof(struct epoll_event);
+#endif
+    for (i = 0; i < tables; ++i)
+    {
+        all[count] = table[i];
+        bytes[count++] = tablesize[i];
+    }
+
+    /* all of the new tables first, so a failure leaves the old ones */
+    for (i = 0; i < count; ++i)
+    {
+        if (!(grown[i] = malloc(size * bytes[i])))
+        {
+            while (i--) free(grown[i]);
+            return -1;
+        }
+    }
+    for (i = 0; i < count; ++i)
+    {
+        if (pollsize) memcpy(grown[i], *all[i], pollsize * bytes[i]);
+        memset((char *) grown[i] + pollsize * bytes[i], 0,
+               (size - pollsize) * bytes[i]);
+        free(*all[i]);
+        *all[i] = grown[i];
+    }
+
+    /* the lowest new slot is used first */
+    for (pos = size - 1; pos >= pollsize; --pos) freeslot[freecount++] = pos;
+    pollsize = size;
+
+    return 0;
+}
+
+/* all slots free, the lowest is used first */
+static void freeAll(void)
+{
+    int i, pos;
+
+    for (pos = 0; pos < pollsize; ++pos)
+    {
+        polld[pos].fd = polld[pos].events = polld[pos].revents = 0;
+        freeslot[pos] = pollsize - 1 - pos;
+    }
+    for (i = 0; i < tables; ++i) memset(*table[i], 0, pollsize * tablesize[i]);
+    freecount = pollsize;
+    pollused = 0;
+}
+
+/*
+ * keep *ptr, a table with an entry of size bytes for each slot, as
+ * large as polld[]; the entries of a new slot are 0
+ * returns -1 if there is no memory
+ */
+int pollTable(void *ptr, size_t size)
+{
+    void **tp = (void **) ptr;
+
+    if (tables == POLLTABLES) return -1;
+    if (pollsize && growTable(tp, 0, pollsize, size)) return -1;
+    table[tables] = tp;
+    tablesize[tables++] = size;
+
+    return 0;
+}
+
+#ifdef HAVE_EPOLL
+/* add, change or remove polld[pos] in the epoll set */
+static int epollCtl(int op, int pos)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    /* the POLL and EPOLL event bits are the same on Linux */
+    ev.events = polld[pos].events;
+    ev.data.u32 = pos;
+
+    return epoll_ctl(epfd, op, polld[pos].fd, &ev);
+}
+#endif
+
+/*
+ * a slot for fd, waiting for POLLIN and POLLPRI
+ * returns the slot, or -1 if the table is full
+ */
+int addPoll(int fd)
+{
+    int pos, size;
+
+#ifdef HAVE_EPOLL
+    if (epfd < 0 && (epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) return -1;
+#endif
+    if (!freecount)
+    {
+        size = pollsize ? pollsize * 2 : POLLSTART;
+        if (size > pollmax) size = pollmax;
+        if (size <= pollsize || growAll(size)) return -1;
+    }
+
+    pos = freeslot[--freecount];
+    polld[pos].fd = fd;
+    polld[pos].events = (POLLIN | POLLPRI);
+    polld[pos].revents = 0;
+#ifdef HAVE_EPOLL
+    if (epollCtl(EPOLL_CTL_ADD, pos) < 0)
+    {
+        polld[pos].fd = polld[pos].events = 0;
+        freeslot[freecount++] = pos;
+        return -1;
+    }
+#endif
+    slotindex[pos] = pollused;
+    pollslot[pollused++] = pos;
+
+    return pos;
+}
+
+/* wait for other events on a slot */
+void setPoll(int pos, int events)
+{
+    if (!polld[pos].fd || polld[pos].events == events) return;
+    polld[pos].events = events;
+#ifdef HAVE_EPOLL
+    epollCtl(EPOLL_CTL_MOD, pos);
+#endif
+}
+
+/* free a slot, its descriptor stays open */
+void delPoll(int pos)
+{
+    int last;
+
+    if (!polld[pos].fd) return;
+#ifdef HAVE_EPOLL
+    /* fails if the descriptor was closed first, which removed it */
+    epollCtl(EPOLL_CTL_DEL, pos);
+#endif
+    polld[pos].fd = polld[pos].events = polld[pos].revents = 0;
+
+    last = pollslot[--pollused];
+    pollslot[slotindex[pos]] = last;
+    slotindex[last] = slotindex[pos];
+    freeslot[freecount++] = pos;
+}
+
+/*
+ * free a slot and close its descriptor, in that order, as a child
+ * still holding the descriptor would keep it in the epoll set
+ */
+void closePoll(int pos)
+{
+    int fd = polld[pos].fd;
+
+    delPoll(pos);
+    if (fd) close(fd);
+}
+
+/*
+ * wait at most timeout ms for events, as poll()
+ * returns the slots in pollready[], 0 on a timeout, or -1 on an error
+ */
+int waitPoll(int timeout)
+{
+    int events, pos, ready = 0;
+
+#ifdef HAVE_EPOLL
+    /* nothing was ever added */
+    if (epfd < 0 || !pollsize) return poll(NULL, 0, timeout);
+
+    if ((events = epoll_wait(epfd, epready, pollsize, timeout)) <= 0)
+        return events;
+    for (ready = 0; ready < events; ++ready)
+    {
+        pos = epready[ready].data.u32;
+        polld[pos].revents = epready[ready].events;
+        pollready[ready] = pos;
+    }
+#else
+    if ((events = poll(polld, pollsize, timeout)) <= 0) return events;
+    for (pos = 0; ready < events && pos < pollsize; ++pos)
+    {
+        if (!polld[pos].revents) continue;
+        /* file descriptor 0 is a free slot */
+        if (!polld[pos].fd) polld[pos].revents = 0;
+        else pollready[ready++] = pos;
+    }
+#endif
+
+    return ready;
+}
+
+/*
+ * forget every slot, and clear the tables of pollTable(), in a child
+ * after fork(), without changing the epoll set it shares with its
+ * parent; closing the descriptors is up to the child
+ */
+void pollReset(void)
+{
+#ifdef HAVE_EPOLL
+    if (epfd >= 0) close(epfd);
+    epfd = -1;
+#endif
+    freeAll();
+}
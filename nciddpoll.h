@@ -0,0 +1,48 @@
+/*
+ * nciddpoll.h - This file is part of ncidd.
+ *
+ * LA: the poll table, with epoll on Linux and poll() on the other targets
+ *
+ * ncidd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ncidd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ncidd.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* the old TiVo kernels have no epoll, build them with -DNOEPOLL */
+#if defined(__linux__) && !defined(NOEPOLL)
+#define HAVE_EPOLL
+#endif
+
+/* slots the table starts with, it doubles when they are all used */
+#define POLLSTART MAXCONNECT
+
+/* slots the table may grow to, ncidd sets pollmax from --maxclients */
+#define POLLMAX 1024
+
+/* tables that pollTable() keeps as large as polld[] */
+#define POLLTABLES 4
+
+/*
+ * polld[pos] is a slot, with fd 0 if it is free; after waitPoll() the
+ * slots with events are in pollready[], and pollslot[] always has the
+ * pollused slots in use, in no order; all have pollsize entries
+ */
+extern struct pollfd *polld;
+extern int *pollready, *pollslot, pollused, pollsize, pollmax;
+
+extern int  pollTable(void *table, size_t size);
+extern int  addPoll(int fd);
+extern void setPoll(int pos, int events);
+extern void delPoll(int pos);
+extern void closePoll(int pos);
+extern int  waitPoll(int timeout);
+extern void pollReset(void);